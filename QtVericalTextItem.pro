@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -8,13 +8,48 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Remove all TRACE_SCOPE trace points at compile time.
+#DEFINES += VERTICALTEXT_NO_TRACE
+
 SOURCES += \
+    cboundaryindex.cpp \
+    cglyphcache.cpp \
     cgraphicsedit.cpp \
+    clatencyhistogram.cpp \
+    cmappedtextfile.cpp \
+    cpropertycoalescer.cpp \
+    cscenesearch.cpp \
+    cselectionmimedata.cpp \
+    cshapecache.cpp \
+    ctextimporter.cpp \
+    ctextsearch.cpp \
+    ctilerenderer.cpp \
+    ctrace.cpp \
     main.cpp \
+    scharformat.cpp \
+    verticaltextdocument.cpp \
+    verticaltextlayout.cpp \
     widget.cpp
 
 HEADERS += \
+    cboundaryindex.h \
+    cglyphcache.h \
     cgraphicsedit.h \
+    clatencyhistogram.h \
+    cmappedtextfile.h \
+    cmpscqueue.h \
+    cpropertycoalescer.h \
+    cscenesearch.h \
+    cselectionmimedata.h \
+    cshapecache.h \
+    ctextimporter.h \
+    ctextsearch.h \
+    ctilerenderer.h \
+    ctrace.h \
+    cverticalorientation.h \
+    scharformat.h \
+    verticaltextdocument.h \
+    verticaltextlayout.h \
     widget.h
 
 # Default rules for deployment.
@@ -0,0 +1,11 @@
+QT       += core gui widgets testlib concurrent
+
+CONFIG += c++17 testcase
+CONFIG -= app_bundle
+
+TARGET = tst_benchmarks
+
+include(../tests/verticaltext.pri)
+
+SOURCES += \
+    tst_benchmarks.cpp
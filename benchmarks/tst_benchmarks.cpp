@@ -0,0 +1,444 @@
+#if defined(_MSC_VER) && (_MSC_VER >= 1600)
+# pragma execution_character_set("utf-8")
+#endif
+
+#include <QtTest>
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QGraphicsSceneMouseEvent>
+#include <QStyleOptionGraphicsItem>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QImage>
+#include "cgraphicsedit.h"
+#include "editfixture.h"
+#include "verticaltextlayout.h"
+#include "ctextsearch.h"
+#include "cshapecache.h"
+
+//性能基准：在offscreen平台上对1k到1M字符的中英混排文档计时
+//运行：tst_benchmarks [-tickcounter | -callgrind] [函数名[:数据行]]
+class tst_Benchmarks : public QObject
+{
+    Q_OBJECT
+private slots:
+    void layoutCold_data() { addSizes(); }
+    void layoutCold();
+    void layoutShared_data() { addSizes(); }
+    void layoutShared();
+    void orientationSwitch_data() { addSizes(); }
+    void orientationSwitch();
+    void boundingRect_data() { addSizes(); }
+    void boundingRect();
+    void paint_data();
+    void paint();
+    void hitTest_data() { addSizes(); }
+    void hitTest();
+    void typing_data() { addPositions(); }
+    void typing();
+    void backspace_data() { addPositions(); }
+    void backspace();
+    void enter_data() { addPositions(); }
+    void enter();
+    void selectAllFormat_data() { addSizes(); }
+    void selectAllFormat();
+    void undoRedo_data() { addSizes(); }
+    void undoRedo();
+    void toHtml_data() { addSizes(); }
+    void toHtml();
+    void setText_data() { addSizes(); }
+    void setText();
+    void feedAppend_data() { addSizes(); }
+    void feedAppend();
+    void findAll_data() { addSizes(); }
+    void findAll();
+    void replaceAll_data() { addSizes(); }
+    void replaceAll();
+private:
+    static void addSizes();
+    static void addPositions();
+};
+
+//生成指定字符数的文档：中英文交替，列长和格式循环变化
+static VerticalTextDocument makeDocument(int chars)
+{
+    static const QString cjk = QStringLiteral("竖排文字输入框支持上中下三种对齐方式字体颜色字间距列间距");
+    static const QString ascii = QStringLiteral("Vertical text item 0123456789 ");
+    //几种常用格式
+    QVector<int> ids;
+    for (int i = 0; i < 6; ++i) {
+        SCharFormat sf;
+        sf.fontSize = 10 + (i % 3) * 4;
+        sf.bold = (i % 2 == 1);
+        sf.italic = (i == 4);
+        sf.underline = (i == 5);
+        sf.fontColor = QColor::fromHsv(i * 60, 200, 160);
+        ids << CFormatRegistry::intern(sf);
+    }
+
+    VerticalTextDocument doc;
+    QString run;
+    int written = 0;
+    int column = 0;
+    int columnLength = 0;
+    int k = 0;
+    while (written < chars) {
+        //中文片段和英文片段交替，长度在3到17之间
+        const QString& src = (k % 2 == 0 ? cjk : ascii);
+        const int n = qMin(3 + (k * 7) % 15, chars - written);
+        run.resize(0);
+        for (int j = 0; j < n; ++j) {
+            run += src.at((k * 5 + j) % src.length());
+        }
+        doc.append(QStringView(run), ids.at(k % ids.size()));
+        written += n;
+        columnLength += n;
+        ++k;
+        //列长在20到80之间变化
+        if (columnLength >= 20 + (column * 13) % 61 && written < chars) {
+            doc.append(QStringView(u"\n"), ids.first());
+            ++written;
+            ++column;
+            columnLength = 0;
+        }
+    }
+    return doc;
+}
+
+static const int POS_START = 0;
+static const int POS_MIDDLE = 1;
+static const int POS_END = 2;
+
+void tst_Benchmarks::addSizes()
+{
+    QTest::addColumn<int>("chars");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+    QTest::newRow("1M") << 1000000;
+}
+
+void tst_Benchmarks::addPositions()
+{
+    QTest::addColumn<int>("chars");
+    QTest::addColumn<int>("where");
+    const int sizes[] = {1000, 10000, 100000, 1000000};
+    const char* names[] = {"1k", "10k", "100k", "1M"};
+    for (int i = 0; i < 4; ++i) {
+        QTest::newRow(QByteArray(names[i]).append("/start").constData()) << sizes[i] << POS_START;
+        QTest::newRow(QByteArray(names[i]).append("/middle").constData()) << sizes[i] << POS_MIDDLE;
+        QTest::newRow(QByteArray(names[i]).append("/end").constData()) << sizes[i] << POS_END;
+    }
+}
+
+static int positionFor(int where, int length)
+{
+    if (where == POS_START)
+        return 0;
+    if (where == POS_MIDDLE)
+        return length / 2;
+    return length;
+}
+
+//图像中是否画了白色以外的像素
+static bool hasInk(const QImage& image)
+{
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (line[x] != 0xffffffff)
+                return true;
+        }
+    }
+    return false;
+}
+
+void tst_Benchmarks::layoutCold()
+{
+    QFETCH(int, chars);
+    const VerticalTextDocument doc = makeDocument(chars);
+    VerticalTextLayout layout;
+    layout.setDocument(&doc);
+    QBENCHMARK {
+        //不命中进程级排版缓存
+        CShapeCache::clear();
+        layout.invalidate();
+        layout.boundingRect();
+    }
+    QVERIFY(!layout.boundingRect().isEmpty());
+}
+
+//同样内容的文档重新打开：列度量全部来自CShapeCache
+void tst_Benchmarks::layoutShared()
+{
+    QFETCH(int, chars);
+    const VerticalTextDocument doc = makeDocument(chars);
+    VerticalTextLayout warm;
+    warm.setDocument(&doc);
+    warm.boundingRect();
+    CShapeCache::resetStats();
+    QBENCHMARK {
+        VerticalTextLayout layout;
+        layout.setDocument(&doc);
+        layout.boundingRect();
+    }
+    const CShapeCache::SStats ss = CShapeCache::stats();
+    QVERIFY(ss.hits > 0);
+}
+
+void tst_Benchmarks::boundingRect()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    QGraphicsItem* item = f.edit;
+    item->boundingRect();
+    QBENCHMARK {
+        item->boundingRect();
+    }
+    QVERIFY(!item->boundingRect().isEmpty());
+}
+
+void tst_Benchmarks::orientationSwitch()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    f.bounds();
+    bool vertical = true;
+    QBENCHMARK {
+        vertical = !vertical;
+        f.edit->setTextOriection(vertical ? CGraphicsEdit::TextVertical : CGraphicsEdit::TextHorizontal);
+        f.bounds();
+    }
+    QVERIFY(!f.bounds().isEmpty());
+}
+
+void tst_Benchmarks::paint_data()
+{
+    QTest::addColumn<int>("chars");
+    QTest::addColumn<bool>("vertical");
+    const int sizes[] = {1000, 10000, 100000, 1000000};
+    const char* names[] = {"1k", "10k", "100k", "1M"};
+    for (int i = 0; i < 4; ++i) {
+        QTest::newRow(QByteArray(names[i]).append("/vertical").constData()) << sizes[i] << true;
+        QTest::newRow(QByteArray(names[i]).append("/horizontal").constData()) << sizes[i] << false;
+    }
+}
+
+void tst_Benchmarks::paint()
+{
+    QFETCH(int, chars);
+    QFETCH(bool, vertical);
+    SEditFixture f(makeDocument(chars));
+    f.edit->setTextOriection(vertical ? CGraphicsEdit::TextVertical : CGraphicsEdit::TextHorizontal);
+    QGraphicsItem* item = f.edit;
+    const QRectF r = item->boundingRect();
+
+    //按一个屏幕大小绘制文档开头部分（竖排从右上角开始）
+    QImage image(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    QStyleOptionGraphicsItem option;
+    option.exposedRect = (vertical ? QRectF(r.right() - image.width(), r.top(), image.width(), image.height())
+                                   : QRectF(r.topLeft(), QSizeF(image.width(), image.height())));
+    QBENCHMARK {
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.translate(-option.exposedRect.topLeft());
+        item->paint(&painter, &option);
+    }
+    QVERIFY(hasInk(image));
+}
+
+void tst_Benchmarks::hitTest()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    const QRectF r = f.bounds();
+    //固定的伪随机点
+    QVector<QPointF> points;
+    for (int i = 0; i < 64; ++i) {
+        points << QPointF(r.left() + r.width() * ((i * 37) % 64) / 64.0,
+                          r.top() + r.height() * ((i * 23) % 64) / 64.0);
+    }
+    QGraphicsSceneMouseEvent press(QEvent::GraphicsSceneMousePress);
+    press.setButton(Qt::LeftButton);
+    press.setButtons(Qt::LeftButton);
+    QGraphicsSceneMouseEvent release(QEvent::GraphicsSceneMouseRelease);
+    release.setButton(Qt::LeftButton);
+    QBENCHMARK {
+        for (const QPointF& p : points) {
+            press.setPos(p);
+            release.setPos(p);
+            f.scene.sendEvent(f.edit, &press);
+            f.scene.sendEvent(f.edit, &release);
+        }
+    }
+    //点击后光标落在有效位置上，可以继续输入
+    const int length = f.length();
+    f.key(Qt::Key_A, QStringLiteral("a"));
+    QCOMPARE(f.length(), length + 1);
+}
+
+void tst_Benchmarks::typing()
+{
+    QFETCH(int, chars);
+    QFETCH(int, where);
+    SEditFixture f(makeDocument(chars));
+    f.bounds();
+    f.edit->setCursorPosition(positionFor(where, f.length()));
+    const int length = f.length();
+    int presses = 0;
+    QBENCHMARK {
+        f.key(Qt::Key_A, QStringLiteral("a"));
+        f.bounds();
+        ++presses;
+    }
+    QCOMPARE(f.length(), length + presses);
+}
+
+void tst_Benchmarks::backspace()
+{
+    QFETCH(int, chars);
+    QFETCH(int, where);
+    SEditFixture f(makeDocument(chars));
+    f.bounds();
+    //开头无法退格，从第一列末尾开始
+    const int start = (where == POS_START ? f.edit->document().columnLength(0) : positionFor(where, f.length()));
+    f.edit->setCursorPosition(start);
+    const int length = f.length();
+    int presses = 0;
+    QBENCHMARK {
+        f.key(Qt::Key_Backspace);
+        f.bounds();
+        ++presses;
+    }
+    //每次删除一个字符或一个换行，到文档开头为止
+    QCOMPARE(f.length(), length - qMin(presses, start));
+}
+
+void tst_Benchmarks::enter()
+{
+    QFETCH(int, chars);
+    QFETCH(int, where);
+    SEditFixture f(makeDocument(chars));
+    f.bounds();
+    f.edit->setCursorPosition(positionFor(where, f.length()));
+    const int columns = f.edit->document().columnCount();
+    int presses = 0;
+    QBENCHMARK {
+        f.key(Qt::Key_Return, QStringLiteral("\r"));
+        f.bounds();
+        ++presses;
+    }
+    QCOMPARE(f.edit->document().columnCount(), columns + presses);
+}
+
+void tst_Benchmarks::selectAllFormat()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    f.bounds();
+    bool bold = false;
+    QBENCHMARK {
+        f.shortcut(QKeySequence::SelectAll);
+        bold = !bold;
+        f.edit->setBold(bold);
+        f.bounds();
+    }
+    const VerticalTextDocument& doc = f.edit->document();
+    QCOMPARE(CFormatRegistry::format(doc.formatAt(0, 0)).bold, bold);
+    QCOMPARE(CFormatRegistry::format(doc.formatAt(doc.columnCount() - 1, 0)).bold, bold);
+}
+
+void tst_Benchmarks::undoRedo()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    f.edit->setCursorPosition(f.length() / 2);
+    for (int i = 0; i < 16; ++i) {
+        f.key(Qt::Key_A + i, QString(QChar('a' + i)));
+    }
+    const QString typed = f.edit->text();
+    f.bounds();
+    QBENCHMARK {
+        f.shortcut(QKeySequence::Undo);
+        f.bounds();
+        f.shortcut(QKeySequence::Redo);
+        f.bounds();
+    }
+    QCOMPARE(f.edit->text(), typed);
+}
+
+void tst_Benchmarks::toHtml()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    QString html;
+    QBENCHMARK {
+        html = f.edit->toHtml();
+    }
+    QVERIFY(!html.isEmpty());
+}
+
+void tst_Benchmarks::setText()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    const QString html = f.edit->toHtml();
+    QBENCHMARK {
+        f.edit->setText(html);
+        f.bounds();
+    }
+    QVERIFY(!f.edit->document().isEmpty());
+}
+
+void tst_Benchmarks::feedAppend()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    //列数保持不变，每次追加一列同时移出一列
+    f.edit->setMaximumColumnCount(f.edit->document().columnCount());
+    f.bounds();
+    QBENCHMARK {
+        f.edit->appendText(QStringView(u"滚动显示的一列\n"));
+        f.bounds();
+    }
+    QCOMPARE(f.edit->document().columnCount(), f.edit->maximumColumnCount());
+}
+
+void tst_Benchmarks::findAll()
+{
+    QFETCH(int, chars);
+    const VerticalTextDocument doc = makeDocument(chars);
+    const CTextSearch search(QStringLiteral("TEXT item"), Qt::CaseInsensitive);
+    int count = 0;
+    QBENCHMARK {
+        count = search.findAll(doc).size();
+    }
+    QVERIFY(count > 0);
+}
+
+void tst_Benchmarks::replaceAll()
+{
+    QFETCH(int, chars);
+    SEditFixture f(makeDocument(chars));
+    f.edit->setSearchPattern(QStringLiteral("文字"));
+    f.bounds();
+    //替换后撤销，每次迭代的文档相同
+    QBENCHMARK {
+        f.edit->replaceAll(QStringLiteral("字符"));
+        f.bounds();
+        f.shortcut(QKeySequence::Undo);
+    }
+    QVERIFY(f.edit->matchCount() > 0);
+}
+
+int main(int argc, char *argv[])
+{
+    //默认不需要显示环境
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    tst_Benchmarks tc;
+    return QTest::qExec(&tc, argc, argv);
+}
+
+#include "tst_benchmarks.moc"
@@ -0,0 +1,167 @@
+#include "cbatchrenderer.h"
+#include <QPainter>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadStorage>
+#include <QDataStream>
+#include "ctrace.h"
+
+//每个线程复用一个排版对象，保留字体度量缓存
+static QThreadStorage<VerticalTextLayout*> s_layouts;
+
+static VerticalTextLayout& threadLayout()
+{
+    if (!s_layouts.hasLocalData()) {
+        VerticalTextLayout* layout = new VerticalTextLayout;
+        //已按文档并行，不再嵌套使用全局线程池
+        layout->setParallel(false);
+        s_layouts.setLocalData(layout);
+    }
+    return *s_layouts.localData();
+}
+
+namespace {
+class RenderTask : public QRunnable
+{
+public:
+    RenderTask(const CBatchRenderer* renderer, const QString& input, const QString& output,
+               QAtomicInt* done, QMutex* mutex, QStringList* errors):
+        m_renderer(renderer),
+        m_input(input),
+        m_output(output),
+        m_done(done),
+        m_mutex(mutex),
+        m_errors(errors)
+    {
+
+    }
+
+    void run() override {
+        QString error;
+        qreal spacing = 0;
+        const VerticalTextDocument doc = CBatchRenderer::loadDocument(m_input, &spacing, &error);
+        if (error.isEmpty()) {
+            const QImage image = m_renderer->render(doc, spacing);
+            if (image.save(m_output, "PNG")) {
+                m_done->fetchAndAddRelaxed(1);
+                return;
+            }
+            error = QStringLiteral("%1: cannot write %2").arg(m_input, m_output);
+        }
+        if (m_errors) {
+            QMutexLocker locker(m_mutex);
+            m_errors->append(error);
+        }
+    }
+private:
+    const CBatchRenderer*   m_renderer;
+    QString                 m_input;
+    QString                 m_output;
+    QAtomicInt*             m_done;
+    QMutex*                 m_mutex;
+    QStringList*            m_errors;
+};
+}
+
+CBatchRenderer::CBatchRenderer(const SRenderOptions& options):
+    m_options(options)
+{
+
+}
+
+void CBatchRenderer::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+VerticalTextDocument CBatchRenderer::loadDocument(const QString& fileName, qreal* columnSpacing, QString* error)
+{
+    TRACE_SCOPE(lcTraceImport, "CBatchRenderer::loadDocument");
+    if (columnSpacing) *columnSpacing = 0;
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+        return VerticalTextDocument();
+    }
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == QLatin1String("vtd")) {
+        QDataStream in(&file);
+        bool ok = false;
+        VerticalTextDocument doc = VerticalTextDocument::load(in, columnSpacing, &ok);
+        if (!ok && error) *error = QStringLiteral("%1: invalid document").arg(fileName);
+        return doc;
+    }
+    const QByteArray data = file.readAll();
+    if (suffix == QLatin1String("html") || suffix == QLatin1String("htm"))
+        return VerticalTextDocument::fromHtml(QString::fromUtf8(data), columnSpacing);
+
+    VerticalTextDocument doc;
+    const QString text = QString::fromUtf8(data);
+    doc.append(QStringView(text), CFormatRegistry::intern(SCharFormat()));
+    return doc;
+}
+
+QImage CBatchRenderer::render(const VerticalTextDocument& doc, qreal columnSpacing) const
+{
+    TRACE_SCOPE(lcTracePaint, "CBatchRenderer::render");
+    VerticalTextLayout& layout = threadLayout();
+    layout.setOrientation(m_options.orientation);
+    layout.setAlignment(m_options.alignment);
+    layout.setColumnSpacing(columnSpacing);
+    layout.setDocument(&doc);
+
+    const QRectF r = layout.boundingRect();
+    QImage image((r.size() * m_options.scale).toSize(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(m_options.background);
+    {
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setRenderHint(QPainter::TextAntialiasing);
+        painter.scale(m_options.scale, m_options.scale);
+        painter.translate(-r.topLeft());
+        layout.draw(&painter, STextRange());
+    }
+    layout.setDocument(nullptr);
+    return image;
+}
+
+int CBatchRenderer::renderFiles(const QStringList& inputs, const QString& outputDir, QStringList* errors)
+{
+    QDir dir(outputDir);
+    if (!dir.exists())
+        dir.mkpath(QStringLiteral("."));
+
+    //基本名相同的输入（如a/label.html和b/label.vtd）保留扩展名，仍然相同时不渲染并报错
+    //按小写比较，不区分大小写的文件系统上也不会互相覆盖
+    QHash<QString, int> baseNames;
+    for (const QString& input : inputs) {
+        ++baseNames[QFileInfo(input).completeBaseName().toLower()];
+    }
+    QHash<QString, QString> outputs;
+    QAtomicInt done;
+    QMutex mutex;
+    for (const QString& input : inputs) {
+        const QFileInfo info(input);
+        const QString name = (baseNames.value(info.completeBaseName().toLower()) > 1 ? info.fileName()
+                                                                                     : info.completeBaseName());
+        const QString output = dir.filePath(name + QStringLiteral(".png"));
+        const QString key = output.toLower();
+        if (outputs.contains(key)) {
+            if (errors) {
+                //已启动的任务可能同时写入errors
+                QMutexLocker locker(&mutex);
+                errors->append(QStringLiteral("%1: output %2 already used by %3").arg(input, output, outputs.value(key)));
+            }
+            continue;
+        }
+        outputs.insert(key, input);
+        m_pool.start(new RenderTask(this, input, output, &done, &mutex, errors));
+    }
+    m_pool.waitForDone();
+    return done.loadAcquire();
+}
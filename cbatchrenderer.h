@@ -0,0 +1,40 @@
+#ifndef CBATCHRENDERER_H
+#define CBATCHRENDERER_H
+
+#include <QImage>
+#include <QColor>
+#include <QStringList>
+#include <QThreadPool>
+#include "verticaltextlayout.h"
+
+//渲染参数
+typedef struct SRenderOptions{
+    VerticalTextLayout::Orientation orientation = VerticalTextLayout::Vertical;
+    int     alignment = VerticalTextLayout::AlignTop;
+    qreal   scale = 1.0;
+    QColor  background = Qt::white;
+} SRenderOptions;
+
+//离屏批量渲染：不经过场景，直接排版并绘制到QImage
+//每个线程有自己的排版对象和画笔，线程之间只共享只读的格式表
+class CBatchRenderer
+{
+public:
+    explicit CBatchRenderer(const SRenderOptions& options = SRenderOptions());
+
+    void setMaxThreadCount(int count);
+    int maxThreadCount() const { return m_pool.maxThreadCount(); }
+
+    //.html/.htm按html读取，.vtd为原生格式，其他按UTF-8纯文本
+    static VerticalTextDocument loadDocument(const QString& fileName, qreal* columnSpacing = nullptr, QString* error = nullptr);
+    //可在任意线程调用
+    QImage render(const VerticalTextDocument& doc, qreal columnSpacing = 0) const;
+    //并行渲染并写出outputDir/<文件名>.png，返回成功数量
+    //去掉扩展名后重名的输入写出<文件名>.<扩展名>.png，仍然重名的输入不渲染，记为错误
+    int renderFiles(const QStringList& inputs, const QString& outputDir, QStringList* errors = nullptr);
+private:
+    SRenderOptions  m_options;
+    QThreadPool     m_pool;
+};
+
+#endif // CBATCHRENDERER_H
@@ -0,0 +1,100 @@
+#include "cboundaryindex.h"
+#include <QTextBoundaryFinder>
+#include <algorithm>
+#include "ctrace.h"
+
+void CBoundaryIndex::columnsChanged(int first, int removed, int inserted)
+{
+    if (m_columns.isEmpty())
+        return;
+    //改动的列丢弃，之后的列平移
+    QHash<int, SColumnBoundaries> columns;
+    columns.reserve(m_columns.size());
+    for (auto it = m_columns.constBegin(); it != m_columns.constEnd(); ++it) {
+        if (it.key() < first)
+            columns.insert(it.key(), it.value());
+        else if (it.key() >= first + removed)
+            columns.insert(it.key() + inserted - removed, it.value());
+    }
+    m_columns.swap(columns);
+}
+
+const CBoundaryIndex::SColumnBoundaries& CBoundaryIndex::column(int col) const
+{
+    auto it = m_columns.constFind(col);
+    if (it != m_columns.constEnd())
+        return it.value();
+    TRACE_SCOPE(lcTraceHitTest, "CBoundaryIndex::column");
+    if (m_columns.size() >= MaxColumns)
+        m_columns.clear();
+    const QString s = m_doc->text(col);
+    SColumnBoundaries b;
+    QTextBoundaryFinder graphemes(QTextBoundaryFinder::Grapheme, s);
+    b.graphemes << 0;
+    for (int p = graphemes.toNextBoundary(); p > 0; p = graphemes.toNextBoundary()) {
+        b.graphemes << p;
+    }
+    QTextBoundaryFinder words(QTextBoundaryFinder::Word, s);
+    int start = -1;
+    for (int p = 0; p >= 0; p = words.toNextBoundary()) {
+        //相邻两个单词之间的边界既是结束也是开头
+        const QTextBoundaryFinder::BoundaryReasons reasons = words.boundaryReasons();
+        if ((reasons & QTextBoundaryFinder::EndOfItem) && start >= 0) {
+            b.wordStarts << start;
+            b.wordEnds << p;
+            start = -1;
+        }
+        if (reasons & QTextBoundaryFinder::StartOfItem)
+            start = p;
+    }
+    return m_columns.insert(col, b).value();
+}
+
+int CBoundaryIndex::previousGrapheme(int col, int pos) const
+{
+    const QVector<int>& g = column(col).graphemes;
+    auto it = std::lower_bound(g.constBegin(), g.constEnd(), pos);
+    return (it == g.constBegin() ? 0 : *(it - 1));
+}
+
+int CBoundaryIndex::nextGrapheme(int col, int pos) const
+{
+    const QVector<int>& g = column(col).graphemes;
+    auto it = std::upper_bound(g.constBegin(), g.constEnd(), pos);
+    return (it == g.constEnd() ? g.constLast() : *it);
+}
+
+int CBoundaryIndex::alignToGrapheme(int col, int pos) const
+{
+    const QVector<int>& g = column(col).graphemes;
+    auto it = std::upper_bound(g.constBegin(), g.constEnd(), pos);
+    return (it == g.constBegin() ? 0 : *(it - 1));
+}
+
+int CBoundaryIndex::previousWord(int col, int pos) const
+{
+    const QVector<int>& starts = column(col).wordStarts;
+    auto it = std::lower_bound(starts.constBegin(), starts.constEnd(), pos);
+    return (it == starts.constBegin() ? 0 : *(it - 1));
+}
+
+int CBoundaryIndex::nextWord(int col, int pos) const
+{
+    const SColumnBoundaries& b = column(col);
+    auto it = std::upper_bound(b.wordStarts.constBegin(), b.wordStarts.constEnd(), pos);
+    return (it == b.wordStarts.constEnd() ? b.graphemes.constLast() : *it);
+}
+
+void CBoundaryIndex::wordAt(int col, int pos, int* start, int* end) const
+{
+    const SColumnBoundaries& b = column(col);
+    //最后一个开头不大于pos的单词，点在单词末尾的字符后半时pos等于结尾
+    const int k = int(std::upper_bound(b.wordStarts.constBegin(), b.wordStarts.constEnd(), pos) - b.wordStarts.constBegin()) - 1;
+    if (k >= 0 && pos <= b.wordEnds.at(k)) {
+        *start = b.wordStarts.at(k);
+        *end = b.wordEnds.at(k);
+        return;
+    }
+    *start = alignToGrapheme(col, pos);
+    *end = nextGrapheme(col, *start);
+}
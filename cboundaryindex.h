@@ -0,0 +1,44 @@
+#ifndef CBOUNDARYINDEX_H
+#define CBOUNDARYINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include "verticaltextdocument.h"
+
+//列内的字形簇和单词边界（QTextBoundaryFinder），用到某列时才计算，之后直到该列被修改都直接查表
+//光标按字形簇移动，不会拆开代理对和组合字符；文档修改后调用columnsChanged()（同VerticalTextLayout）
+class CBoundaryIndex
+{
+public:
+    void setDocument(const VerticalTextDocument* doc) { m_doc = doc; invalidate(); }
+    //first开始删除removed列、插入inserted列
+    void columnsChanged(int first, int removed, int inserted);
+    void invalidate() { m_columns.clear(); }
+
+    //pos之前/之后最近的字形簇边界，到列首/列尾为止
+    int previousGrapheme(int col, int pos) const;
+    int nextGrapheme(int col, int pos) const;
+    //pos不在字形簇边界上时退到前一个边界
+    int alignToGrapheme(int col, int pos) const;
+    //pos之前/之后最近的单词开头，没有时为列首/列尾
+    int previousWord(int col, int pos) const;
+    int nextWord(int col, int pos) const;
+    //pos处的单词；不在单词上时为pos处的字形簇
+    void wordAt(int col, int pos, int* start, int* end) const;
+
+    //缓存的列数上限，超出时全部重算
+    static const int MaxColumns = 1024;
+private:
+    typedef struct SColumnBoundaries{
+        QVector<int> graphemes;     //全部字形簇边界，首项为0，末项为列长
+        QVector<int> wordStarts;    //单词开头，与wordEnds一一对应
+        QVector<int> wordEnds;
+    } SColumnBoundaries;
+
+    const SColumnBoundaries& column(int col) const;
+private:
+    const VerticalTextDocument*              m_doc = nullptr;
+    mutable QHash<int, SColumnBoundaries>    m_columns;
+};
+
+#endif // CBOUNDARYINDEX_H
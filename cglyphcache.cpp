@@ -0,0 +1,59 @@
+#include "cglyphcache.h"
+#include <QReadWriteLock>
+#include <QHash>
+#include <QTransform>
+
+namespace {
+struct GlyphTable {
+    QReadWriteLock                  lock;
+    QHash<quint64, QPainterPath>    paths;
+};
+
+GlyphTable& glyphTable()
+{
+    static GlyphTable table;
+    return table;
+}
+
+quint64 glyphKey(int formatId, QChar c, bool sideways)
+{
+    return (quint64(quint32(formatId)) << 32) | (quint64(sideways) << 16) | c.unicode();
+}
+}
+
+QPainterPath CGlyphCache::path(int formatId, const QFont& font, QChar c, bool sideways)
+{
+    GlyphTable& t = glyphTable();
+    const quint64 key = glyphKey(formatId, c, sideways);
+    {
+        QReadLocker locker(&t.lock);
+        auto it = t.paths.constFind(key);
+        if (it != t.paths.constEnd())
+            return it.value();
+    }
+
+    QPainterPath p;
+    p.addText(0, 0, font, QString(c));
+    if (sideways)
+        p = QTransform().rotate(90).map(p);
+
+    QWriteLocker locker(&t.lock);
+    if (t.paths.size() >= MaxEntries)
+        t.paths.clear();
+    t.paths.insert(key, p);
+    return p;
+}
+
+int CGlyphCache::size()
+{
+    GlyphTable& t = glyphTable();
+    QReadLocker locker(&t.lock);
+    return t.paths.size();
+}
+
+void CGlyphCache::clear()
+{
+    GlyphTable& t = glyphTable();
+    QWriteLocker locker(&t.lock);
+    t.paths.clear();
+}
@@ -0,0 +1,21 @@
+#ifndef CGLYPHCACHE_H
+#define CGLYPHCACHE_H
+
+#include <QPainterPath>
+#include <QFont>
+
+//字形轮廓缓存：按(格式ID, 字符, 方向)保存QPainterPath，进程内所有item共用（线程安全）
+//轮廓以基线起点为原点，sideways为true时已顺时针旋转90度，绘制时只需平移
+class CGlyphCache
+{
+public:
+    //font必须是formatId对应的字体（去掉上下划线、删除线）
+    static QPainterPath path(int formatId, const QFont& font, QChar c, bool sideways);
+    static int size();
+    static void clear();
+
+    //超过此数量时清空重建
+    static const int MaxEntries = 8192;
+};
+
+#endif // CGLYPHCACHE_H
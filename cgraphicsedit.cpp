@@ -1,49 +1,170 @@
 #include "cgraphicsedit.h"
+#include "cselectionmimedata.h"
 #include <QTimer>
-#include <QFontMetrics>
 #include <QPainter>
 #include <QKeyEvent>
 #include <QEvent>
 #include <QGuiApplication>
 #include <QGraphicsScene>
 #include <QGraphicsSceneEvent>
+#include <QStyleOptionGraphicsItem>
 #include <QUndoCommand>
-#include <QTextCursor>
-#include <QMutex>
+#include <QMimeData>
 #include <QDebug>
+#include <QtMath>
+#include <cmath>
+#include <algorithm>
+#include "ctrace.h"
+#include "ctilerenderer.h"
+#include "cshapecache.h"
+#include "ctextimporter.h"
+
+static const QColor SELECTION_OVERLAY_COLOR("#0078D7");
+static const QColor SEARCH_HIGHLIGHT_COLOR(255, 200, 0, 128);
+//缩小显示：字符小于GREEK_PIXELS像素时画色块，小于BITMAP_PIXELS时使用低分辨率缓存图
+static const qreal GREEK_PIXELS = 4;
+static const qreal BITMAP_PIXELS = 8;
+//缓存图的最大边长
+static const int LOD_PIXMAP_SIZE = 2048;
+//postAppend的批处理间隔（一帧）
+static const int APPEND_FRAME_MSECS = 16;
+
+//撤销步数上限：快照可能让已移出的列留在内存中，有上限时内存有界
+static const int UNDO_LIMIT = 256;
+
+//编辑命令：记录创建时已移出的列数，执行时按之后移出的列数（setMaximumColumnCount）换算列号
+//移出列时不改写撤销栈，每次追加的开销与撤销步数无关
+class CEditCommand : public QUndoCommand
+{
+public:
+    explicit CEditCommand(CGraphicsEdit* item):
+        m_d(item),
+        m_base(item->m_evictedColumns)
+    {
 
-static const qreal DEFAULT_EDIT_SIZE = 300;
+    }
+
+    //涉及的列已被移出时不能撤销/重做
+    virtual bool canUndo() const = 0;
+    virtual bool canRedo() const = 0;
+protected:
+    //base之后移出的列数
+    int evictedSince(qint64 base) const { return int(m_d->m_evictedColumns - base); }
+    qint64 evictedColumns() const { return m_d->m_evictedColumns; }
+    int cursorPostion() const { return m_d->m_postion; }
+    int cursorColumn() const { return m_d->m_currColumn; }
+    //列间距随文档保存（toHtml），快照一起记录
+    qreal columnSpacing() const { return m_d->m_layout.columnSpacing(); }
+    void restoreColumnSpacing(qreal spacing) { m_d->m_layout.setColumnSpacing(spacing); }
+protected:
+    CGraphicsEdit*      m_d = nullptr;
+    qint64              m_base = 0;         //创建时已移出的列数
+};
 
-class CTextChanged : public QUndoCommand
+class CTextChanged : public CEditCommand
 {
 public:
-    CTextChanged(CGraphicsEdit* item, const QStringList& sl, int pos, int cols, int curCol,
-                 const QList<QList<SCharFormat>>& sf):
-        m_d(item),
-        m_textList(sl),
+    CTextChanged(CGraphicsEdit* item, const VerticalTextDocument& doc, int pos, int curCol):
+        CEditCommand(item),
+        m_doc(doc),
         m_postion(pos),
-        m_cols(cols),
         m_currColumn(curCol),
-        m_sf(sf)
+        m_columnSpacing(columnSpacing())
     {
 
     }
 
     void undo() override {
-        if (m_d) {
-            m_d->updateData(m_textList, m_cols, m_postion, m_currColumn, m_sf);
-        }
+        //记下撤销前的文档，重做时恢复
+        m_redoDoc = m_d->document();
+        m_redoPostion = cursorPostion();
+        m_redoColumn = cursorColumn();
+        m_redoBase = evictedColumns();
+        m_redoSpacing = columnSpacing();
+        m_hasRedo = true;
+        restoreColumnSpacing(m_columnSpacing);
+        restore(m_doc, m_base, m_postion, m_currColumn);
     }
 
     void redo() override {
+        //push时修改还没有发生，之后每次重做都在撤销之后
+        if (m_hasRedo) {
+            restoreColumnSpacing(m_redoSpacing);
+            restore(m_redoDoc, m_redoBase, m_redoPostion, m_redoColumn);
+        }
     }
+
+    bool canUndo() const override { return evictedSince(m_base) < m_doc.columnCount(); }
+    bool canRedo() const override { return !m_hasRedo || evictedSince(m_redoBase) < m_redoDoc.columnCount(); }
 private:
-    CGraphicsEdit*      m_d = nullptr;
-    QStringList         m_textList;
+    //快照之后移出的列从快照中去掉，只复制开头的一块
+    void restore(const VerticalTextDocument& doc, qint64 base, int pos, int col) {
+        const int count = evictedSince(base);
+        if (count == 0) {
+            m_d->updateData(doc, pos, col);
+            return;
+        }
+        VerticalTextDocument snapshot = doc;
+        snapshot.removeFirstColumns(count);
+        if (col < count)
+            m_d->updateData(snapshot, 0, 0);
+        else
+            m_d->updateData(snapshot, pos, col - count);
+    }
+private:
+    VerticalTextDocument m_doc;             //文档快照（隐式共享）
     int                 m_postion = 0;
-    int                 m_cols = 0;          //列数
     int                 m_currColumn = 0;    //当前列标号
-    QList<QList<SCharFormat>> m_sf;
+    qreal               m_columnSpacing = 0;
+    //撤销前的文档，重做时使用
+    VerticalTextDocument m_redoDoc;
+    int                 m_redoPostion = 0;
+    int                 m_redoColumn = 0;
+    qint64              m_redoBase = 0;
+    qreal               m_redoSpacing = 0;
+    bool                m_hasRedo = false;
+};
+
+//插入文本的撤销：记录插入范围和插入的文档（隐式共享），撤销时删除范围，重做时重新插入
+class CTextInserted : public CEditCommand
+{
+public:
+    //在插入之后创建，(endCol, endPos)为插入结束处
+    CTextInserted(CGraphicsEdit* item, int startCol, int startPos, int endCol, int endPos,
+                  const VerticalTextDocument& doc):
+        CEditCommand(item),
+        m_doc(doc),
+        m_startCol(startCol),
+        m_startPos(startPos),
+        m_endCol(endCol),
+        m_endPos(endPos)
+    {
+
+    }
+
+    void undo() override {
+        const int count = evictedSince(m_base);
+        m_d->removeRange(m_startCol - count, m_startPos, m_endCol - count, m_endPos);
+    }
+
+    void redo() override {
+        //push时文字已经插入
+        if (m_first) {
+            m_first = false;
+            return;
+        }
+        m_d->insertDocument(m_startCol - evictedSince(m_base), m_startPos, m_doc);
+    }
+
+    bool canUndo() const override { return m_startCol >= evictedSince(m_base); }
+    bool canRedo() const override { return canUndo(); }
+private:
+    VerticalTextDocument m_doc;             //插入的文档
+    int                 m_startCol = 0;
+    int                 m_startPos = 0;
+    int                 m_endCol = 0;
+    int                 m_endPos = 0;
+    bool                m_first = true;
 };
 
 //文本选中区域
@@ -93,6 +214,8 @@ public:
         }
         return 1;
     }
+    //前面的列被移出，保持选择方向
+    inline void shiftColumns(int count) { m_startCol -= count; m_endCol -= count; }
     inline void setRegion(int beginCol, int endCol, int beginPos, int endPos) {
         m_startCol = beginCol;
         m_startPos = beginPos;
@@ -105,7 +228,6 @@ CGraphicsEdit::CGraphicsEdit(QGraphicsItem* parent):
     QGraphicsObject(parent),
     m_showCursor(false),
     m_postion(0),
-    m_cols(1),
     m_currColumn(0),
     m_selectedRegion(new SelectedRegion),
     m_undoStack(new QUndoStack(this)),
@@ -115,21 +237,27 @@ CGraphicsEdit::CGraphicsEdit(QGraphicsItem* parent):
     setAcceptDrops(true);
     setAcceptHoverEvents(true);
     setAcceptedMouseButtons(Qt::LeftButton);
+    //paint时只绘制暴露区域
+    setFlag(ItemUsesExtendedStyleOption);
     //😂setFlag(ItemIsFocusable);
     //setFocus();
-    //初始化文字列表
-    m_textList << QString("");
-    QList<SCharFormat> sf;
-    m_charFormats << sf;
+    m_textFormatId = CFormatRegistry::intern(m_textFormat);
+    m_undoStack->setUndoLimit(UNDO_LIMIT);
+    m_layout.setDocument(&m_document);
+    m_boundaries.setDocument(&m_document);
+    m_layout.setEmptyColumnFormat(m_textFormatId);
     //光标闪烁
     m_timer = new QTimer(this);
     m_timer->setInterval(500);
     connect(m_timer, &QTimer::timeout, this, &CGraphicsEdit::onTimeout);
-    m_textItem = new QGraphicsTextItem();
+    m_clock.start();
 }
 
 CGraphicsEdit::~CGraphicsEdit()
 {
+    delete m_importer;
+    delete m_formatUndo;
+    delete m_selectedRegion;
     if (m_timer) {
         m_timer->stop();
         delete m_timer;
@@ -139,220 +267,47 @@ CGraphicsEdit::~CGraphicsEdit()
 
 QRectF CGraphicsEdit::boundingRect() const
 {
-    const qreal adjust = 5.0;
-    qreal maxSize = DEFAULT_EDIT_SIZE;
-    for(int i = 0; i < m_textList.size(); ++i) {
-        qreal size;
-        if (m_oriection == TextVertical) {
-            size = getStrHeight(i);
-        } else {
-            size = getStrWidth(i);
-        }
-
-        if (size > maxSize) {
-            maxSize = size;
-        }
-    }
-
-    QRectF r;
-    if (m_oriection == TextVertical) {
-        qreal w = getColXPostion(m_cols - 1);
-        r =  QRectF(-w/2 - adjust, -maxSize/2 - adjust, w + 2*adjust, maxSize + 2*adjust);
-    } else {
-        qreal h = getRowYPostion(m_cols - 1);
-        r = QRectF(-maxSize/2 - adjust, -h/2 - adjust, maxSize + 2*adjust, h + 2*adjust);
-    }
-    return r;
+    return m_layout.boundingRect();
 }
 
-void CGraphicsEdit::verticalPaint(QPainter* painter, const QRectF& r)
+void CGraphicsEdit::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget )
 {
-    const qreal adjust = 5.0;
-    //绘制选中区域
-    int startCol = m_selectedRegion->startCol();
-    int endCol = m_selectedRegion->endCol();
-    int startPos = m_selectedRegion->startPos();
-    int endPos = m_selectedRegion->endPos();
-    if (startCol == endCol && startPos > endPos) {
-        qSwap(startPos, endPos);
-    }
-    if (m_selectedRegion->selected()) {
-        painter->save();
-        for (int i = startCol; i <= endCol; ++i) {
-            const QString s = m_textList.at(i);
-            const qreal colx = getColXPostion(i);
-            const qreal cw = getColWidth(i);
-            int ep = (i != endCol ? s.length() : endPos);
-            int bp = (i != startCol ? 0 : startPos);
-            if (ep == bp) continue;
-            ep -= 1;
-
-            qreal sy = 0;
-            if (m_alignment == AlignmentTop) {
-                sy = r.top() + adjust;
-            } else if (m_alignment == AlignmentCenter) {
-                qreal textHeight = getStrHeight(i);
-                sy = -textHeight/2 - adjust/2;
-            } else {
-                qreal textHeight = getStrHeight(i);
-                sy = r.bottom() - adjust - textHeight;
-            }
-
-            qreal sx = r.right() - colx - adjust;
-            qreal starty = sy;
-            qreal endy = starty;
-            for (int j = 0; j < s.length(); j++) {
-                SCharFormat sf = m_charFormats.at(i).at(j);
-                QFont font;
-                sf.setFont(&font);
-                QFontMetricsF m(font);
-                if (j == bp) {
-                    starty = sy;
-                }
-                QChar c = s.at(j);
-                if (c < 128) {
-                    sy += m.width(c);
-                } else {
-                    sy += m.height();
-                }
-                sy += sf.letterSpacing;
-                if (j == ep) {
-                    endy = sy;
-                }
-            }
+    Q_UNUSED(widget);
 
-            if (starty != endy) {
-                painter->setBrush(QColor("#0078D7"));
-                painter->drawRect(QRectF(sx, starty, cw, endy - starty));
-            }
-        }
-        painter->restore();
-    }
-    //绘制文字
+    TRACE_SCOPE(lcTracePaint, "CGraphicsEdit::paint");
+    const qint64 begin = m_clock.nsecsElapsed();
+    const quint64 glyphs = m_layout.stats().glyphs;
+    const int revision = m_layout.revision();
+    const QRectF r = boundingRect();
+    //绘制虚线框
+    QPen pen;
+    pen.setColor(Qt::black);
+    pen.setStyle(Qt::DotLine);
     painter->save();
-    int index = 0;
-    qreal hx, vy;
-    qreal cursorX = r.right() - adjust - getColXPostion(m_currColumn);
-    qreal cursorY = r.top() + adjust;
-    if (m_alignment == AlignmentCenter) {
-        qreal textHeight = getStrHeight(m_currColumn);
-        cursorY = -textHeight/2 - adjust;
-    } else if (m_alignment == AlignmentBottom) {
-        qreal textHeight = getStrHeight(m_currColumn);
-        cursorY = r.bottom() - adjust - textHeight;
-    }
-
-    for (int i = 0; i < m_textList.size(); i++) {
-        QString l = m_textList.at(i);
-        qreal vx = 0;
-        if (m_alignment == AlignmentTop) {
-            vx = r.top() + adjust;
-        } else if (m_alignment == AlignmentCenter) {
-            qreal textHeight = getStrHeight(i);
-            vx = -textHeight/2 - adjust/2;
-        } else {
-            qreal textHeight = getStrHeight(i);
-            vx = r.bottom() - adjust - textHeight;
-        }
-        bool isCurrLine = (index == m_currColumn);
-        int cursorIndex = 0;
-        qreal underBeginY = vx, underEndY = vx, overBeginY = vx, overEndY = vx, strikeBeginY = vx, strikeEndY = vx;
-        for(int j = 0; j < l.size(); ++j) {
-            QChar c = l.at(j);
-            QPen  textPen;
-            if (m_selectedRegion->selected() && index >= startCol && index <= endCol) {
-                if (startCol == endCol) {
-                    if (cursorIndex >= startPos &&
-                        cursorIndex < endPos) {
-                        textPen.setColor(QColor("#FFF8F0"));
-                    } else {
-                        textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    }
-                } else {
-                    if (index == startCol)
-                        if (cursorIndex >= startPos)
-                            textPen.setColor(QColor("#FFF8F0"));
-                        else
-                            textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    else if (index == endCol)
-                        if (cursorIndex < endPos)
-                            textPen.setColor(QColor("#FFF8F0"));
-                        else
-                            textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    else
-                        textPen.setColor(QColor("#FFF8F0"));
-                }
-            } else {
-                textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-            }
-            painter->setPen(textPen);
-            QFont font;
-            m_charFormats.at(i).at(j).setFont(&font);
-            bool underline = font.underline();
-            bool overline = font.overline();
-            bool strikeout = font.strikeOut();
-            //把删除线，上下划线属性去除，效果不好，自定义实现
-            font.setUnderline(false);
-            font.setStrikeOut(false);
-            font.setOverline(false);
-            painter->setFont(font);
-            underBeginY = vx;
-            overBeginY = vx;
-            strikeBeginY = vx;
-            const qreal colx = getColXPostion(i);
-            const qreal cw = getColWidth(i);
-            QFontMetricsF m(font);
-            if (c < 128) {
-                painter->rotate(90);
-                qreal w = m.width(c);
-                vy = -r.right() + colx - cw/4 + adjust;
-                painter->drawText(QPointF(vx, vy), c);
-                vx += w + font.letterSpacing();
-                painter->rotate(-90);
-            } else {
-                qreal w = m.width(c);
-                hx = r.right() - colx + (cw - w)/2 - adjust;
-                painter->drawText(QPointF(hx, vx + m.ascent()), c);
-                vx += m.height() + font.letterSpacing();
-            }
-
-            //左划线
-            if (underline) {
-                underEndY = vx;
-                if (underEndY != underBeginY) {
-                    painter->drawLine(r.right() - colx - adjust, underBeginY,
-                                      r.right() - colx - adjust, underEndY);
-                }
-            }
-            //右划线
-            if (overline) {
-                overEndY = vx;
-                if (overEndY != overBeginY) {
-                    qreal linex = r.right() - adjust;
-                    if (i > 0) {
-                        linex -= getColXPostion(i - 1);
-                    }
-                    painter->drawLine(linex, overBeginY, linex, overEndY);
-                }
-            }
-            //删除线.
-            if (strikeout) {
-                strikeEndY = vx;
-                if (strikeEndY != strikeBeginY) {
-                    painter->drawLine(r.right() - colx + cw/2 - adjust, strikeBeginY,
-                                      r.right() - colx + cw/2 - adjust, strikeEndY);
-                }
-            }
-
-            //光标y坐标
-            if (isCurrLine && ((cursorIndex + 1) == m_postion)) {
-                cursorY = vx;
-            }
-            ++cursorIndex;
-        }
-        ++index;
-    }
+    painter->setPen(pen);
+    painter->drawRect(r);
     painter->restore();
+    //绘制选中区域和文字
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const qreal glyphPixels = lod * m_layout.averageColumnThickness();
+    if (glyphPixels < GREEK_PIXELS) {
+        //字太小看不清，只画色块
+        m_layout.drawGreeked(painter, option->exposedRect);
+        drawMatches(painter, option->exposedRect);
+        drawSelectionOverlay(painter);
+    } else if (glyphPixels < BITMAP_PIXELS && !m_layout.isVirtualized() && drawLodPixmap(painter, lod * painter->device()->devicePixelRatioF())) {
+        drawMatches(painter, option->exposedRect);
+        drawSelectionOverlay(painter);
+    } else if (m_tileRenderer && !m_layout.isVirtualized()) {
+        //文字由工作线程分块绘制，选中区域半透明叠加
+        m_tileRenderer->setSource(m_document, m_layout);
+        m_tileRenderer->paint(painter, option->exposedRect, lod * painter->device()->devicePixelRatioF());
+        drawMatches(painter, option->exposedRect);
+        drawSelectionOverlay(painter);
+    } else {
+        drawMatches(painter, option->exposedRect);
+        m_layout.draw(painter, selectedRange(), option->exposedRect);
+    }
     //绘制光标
     painter->save();
     if (!m_showCursor) {
@@ -361,177 +316,42 @@ void CGraphicsEdit::verticalPaint(QPainter* painter, const QRectF& r)
         pen2.setColor(Qt::transparent);
         painter->setPen(pen2);
     }
-    painter->drawLine(QPointF(cursorX, cursorY), QPointF(cursorX + getColWidth(m_currColumn), cursorY));
+    painter->drawLine(m_layout.caretLine(m_currColumn, m_postion));
     painter->restore();
-}
-
-void CGraphicsEdit::horizontalPaint(QPainter* painter, const QRectF& r)
-{
-    const qreal adjust = 5.0;
-    //绘制选中区域
-    int startCol = m_selectedRegion->startCol();
-    int endCol = m_selectedRegion->endCol();
-    int startPos = m_selectedRegion->startPos();
-    int endPos = m_selectedRegion->endPos();
-    if (startCol == endCol && startPos > endPos) {
-        qSwap(startPos, endPos);
-    }
-    if (m_selectedRegion->selected()) {
-        painter->save();
-        for (int i = startCol; i <= endCol; ++i) {
-            const QString s = m_textList.at(i);
-            const qreal rowy = (i == 0 ? 0 : getRowYPostion(i - 1));
-            const qreal rh = getRowHeight(i);
-            int ep = (i != endCol ? s.length() : endPos);
-            int bp = (i != startCol ? 0 : startPos);
-            if (ep == bp) continue;
-            ep -= 1;
-
-            qreal sx = 0;
-            if (m_alignment == AlignmentRight) {
-                qreal textWidth = getStrWidth(i);
-                sx = r.right() - adjust - textWidth;
-            } else if (m_alignment == AlignmentHCenter) {
-                qreal textWidth = getStrWidth(i);
-                sx = r.left() + adjust + textWidth/2;
-            } else {
-                sx = r.left() + adjust;
-            }
-
-            qreal sy = r.top() + rowy + adjust;
-            qreal startx = sx, endx = sx;
-            for (int j = 0; j < s.length(); j++) {
-                SCharFormat sf = m_charFormats.at(i).at(j);
-                QFont font;
-                sf.setFont(&font);
-                QFontMetricsF m(font);
-                if (j == bp) {
-                    startx = sx;
-                }
-                QChar c = s.at(j);
-                sx += m.width(c) + sf.letterSpacing;
-                if (j == ep) {
-                    endx = sx;
-                }
-            }
-
-            if (startx != endx) {
-                QPen pen;
-                pen.setWidth(0);
-                painter->setPen(pen);
-                painter->setBrush(QColor("#0078D7"));
-                painter->drawRect(QRectF(startx, sy, endx - startx, rh));
-            }
-        }
-        painter->restore();
+    //虚拟显示时新度量的列可能修正了估计的尺寸，绘制结束后再更新几何
+    if (m_layout.revision() != revision) {
+        QTimer::singleShot(0, this, [this]() {
+            prepareGeometryChange();
+            update();
+        });
     }
-    //绘制文字
-    painter->save();
-    qreal cursory = r.top() + adjust + getRowYPostion(m_currColumn);
-    qreal cursorx = r.left() + adjust;
-    if (m_alignment == AlignmentRight) {
-        qreal textWidth = getStrWidth(m_currColumn);
-        cursorx = r.right() - adjust - textWidth;
-    } else if (m_alignment == AlignmentHCenter) {
-        qreal textWidth = getStrWidth(m_currColumn);
-        cursorx = r.left() + adjust + textWidth/2;
-    }
-
-    for (int i = 0; i < m_textList.size(); i++) {
-        QString l = m_textList.at(i);
-        qreal textx = r.left() + adjust;
-        const qreal texty = r.top() + getRowYPostion(i);
-        if (m_alignment == AlignmentRight) {
-            qreal textWidth = getStrWidth(i);
-            textx = r.right() - adjust - textWidth;
-        } else if (m_alignment == AlignmentHCenter) {
-            qreal textWidth = getStrWidth(m_currColumn);
-            textx = r.left() + adjust + textWidth/2;
-        }
 
-        bool isCurrLine = (i == m_currColumn);
-        for(int j = 0; j < l.size(); ++j) {
-            QChar c = l.at(j);
-            QPen  textPen;
-            if (m_selectedRegion->selected() && i >= startCol && i <= endCol) {
-                if (startCol == endCol) {
-                    if (j >= startPos && j < endPos) {
-                        textPen.setColor(QColor("#FFF8F0"));
-                    } else {
-                        textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    }
-                } else {
-                    if (i == startCol)
-                        if (j >= startPos)
-                            textPen.setColor(QColor("#FFF8F0"));
-                        else
-                            textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    else if (i == endCol)
-                        if (j < endPos)
-                            textPen.setColor(QColor("#FFF8F0"));
-                        else
-                            textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-                    else
-                        textPen.setColor(QColor("#FFF8F0"));
-                }
-            } else {
-                textPen.setColor(m_charFormats.at(i).at(j).fontColor);
-            }
-            painter->setPen(textPen);
-            QFont font;
-            m_charFormats.at(i).at(j).setFont(&font);
-            painter->setFont(font);
-            QFontMetricsF m(font);
-
-            painter->drawText(QPointF(textx, texty - m.descent()), c);
-            textx += m.width(c) + font.letterSpacing();
-
-            //光标x坐标
-            if (isCurrLine && ((j + 1) == m_postion)) {
-                cursorx = textx;
-            }
-        }
-    }
-    painter->restore();
-    //绘制光标
-    painter->save();
-    if (!m_showCursor) {
-        QPen pen2;
-        pen2.setStyle(Qt::SolidLine);
-        pen2.setColor(Qt::transparent);
-        painter->setPen(pen2);
-    }
-    painter->drawLine(QPointF(cursorx, cursory), QPointF(cursorx, cursory - getRowHeight(m_currColumn)));
-    painter->restore();
-}
-
-void CGraphicsEdit::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget )
-{
-    Q_UNUSED(option);
-    Q_UNUSED(widget);
-
-    const QRectF r = boundingRect();
-    //绘制虚线框
-    QPen pen;
-    pen.setColor(Qt::black);
-    pen.setStyle(Qt::DotLine);
-    painter->save();
-    painter->setPen(pen);
-    painter->drawRect(r);
-    painter->restore();
-    if (m_oriection == TextVertical) {
-        verticalPaint(painter, r);
-    } else {
-        horizontalPaint(painter, r);
+    const qint64 end = m_clock.nsecsElapsed();
+    m_paintTime = end - begin;
+    m_frameGlyphs = int(m_layout.stats().glyphs - glyphs);
+    if (m_inputStart >= 0) {
+        m_latency.record(end - m_inputStart);
+        m_inputStart = -1;
     }
 }
 
 void CGraphicsEdit::keyPressEvent(QKeyEvent *e)
 {
-    if (!(interactionFlags & Qt::TextEditable)) {
+    //只读文档可以选择，不能编辑
+    if (!(interactionFlags & Qt::TextEditable) || isReadOnly()) {
+#if !defined(QT_NO_SHORTCUT) && !defined(QT_NO_CLIPBOARD)
+        //只读时仍可复制选中文字
+        if ((interactionFlags & Qt::TextSelectableByKeyboard) && e == QKeySequence::Copy) {
+            copy();
+            e->accept();
+            return;
+        }
+#endif
         e->ignore();
         return;
     }
+    //只有处理了的按键才计时；修饰键和不可打印的键被忽略，不会触发绘制
+    const qint64 inputStart = m_clock.nsecsElapsed();
 
 #ifndef QT_NO_SHORTCUT
     if (e == QKeySequence::SelectAll) {
@@ -573,54 +393,28 @@ void CGraphicsEdit::keyPressEvent(QKeyEvent *e)
             if (m_currColumn == 0 && m_postion == 0)
                 break;
 
-            QUndoCommand* command = new CTextChanged(this, m_textList, m_postion, m_cols, m_currColumn, m_charFormats);
-            m_undoStack->push(command);
+            QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+            pushUndo(command);
 
-            QString l = m_textList.at(m_currColumn);
-            QList<SCharFormat> sf = m_charFormats.at(m_currColumn);
             if (m_postion == 0) {
-                if (m_cols > 1) {
-                    m_textList.removeAt(m_currColumn);
-                    m_charFormats.removeAt(m_currColumn);
-                }
-                m_cols--;
-                m_currColumn--;
-                QString lstr = m_textList.at(m_currColumn);
-                QList<SCharFormat> lsf = m_charFormats.at(m_currColumn);
-                m_postion = lstr.length();
-                m_textList[m_currColumn] = lstr + l;
-                lsf.append(sf);
-                m_charFormats[m_currColumn].swap(lsf);
+                //与上一列合并
+                const int prev = m_currColumn - 1;
+                removeRange(prev, m_document.columnLength(prev), m_currColumn, 0);
             } else {
-                l.remove(m_postion - 1, 1);
-                sf.erase(sf.begin() + (m_postion - 1), sf.begin() + m_postion);
-                m_textList[m_currColumn] = l;
-                m_charFormats[m_currColumn].swap(sf);
-                m_postion--;
+                removeRange(m_currColumn, m_boundaries.previousGrapheme(m_currColumn, m_postion), m_currColumn, m_postion);
             }
         } while (0);
-        scene()->update();
         goto accept;
     } else if (e->key() == Qt::Key_Enter || e->key() == Qt::Key_Return) {
-        deleteSelectText();
-        QString l = m_textList.at(m_currColumn);
-        QString rStr = l.right(l.length() - m_postion);
-        QString lStr = l.left(m_postion);
-        QList<SCharFormat>& sf = m_charFormats[m_currColumn];
-        QList<SCharFormat> rsf;
-        for (int i = 0; i < sf.size(); ++i) {
-            if (i >= m_postion) {
-                rsf.push_back(sf.at(i));
-            }
+        //选中文字时删除操作已记录快照，整体只占一个撤销步骤
+        if (m_selectedRegion->selected()) {
+            deleteSelectText();
+        } else {
+            pushUndo(new CTextChanged(this, m_document, m_postion, m_currColumn));
         }
-        sf.erase(sf.begin() + m_postion, sf.end());
-        m_textList[m_currColumn] = lStr;
-        m_cols++;
-        m_currColumn++;
-        m_textList.insert(m_currColumn, rStr);
-        m_charFormats.insert(m_currColumn, rsf);
-        m_postion = 0;
-        scene()->update();
+        VerticalTextDocument newLine;
+        newLine.append(QStringView(u"\n"), m_textFormatId);
+        insertDocument(m_currColumn, m_postion, newLine);
         goto accept;
     } else if (e->key() == Qt::Key_Delete) {
         do {
@@ -629,136 +423,62 @@ void CGraphicsEdit::keyPressEvent(QKeyEvent *e)
                 break;
             }
 
-            QUndoCommand* command = new CTextChanged(this, m_textList, m_postion, m_cols, m_currColumn, m_charFormats);
-            m_undoStack->push(command);
-
-            QString s = m_textList.at(m_currColumn);
-            QList<SCharFormat> sf = m_charFormats.at(m_currColumn);
-            if ((m_currColumn == 0 && s.isEmpty() && m_cols == 1) ||
-                (m_currColumn + 1 == m_cols && s.length() == m_postion))
+            const int length = m_document.columnLength(m_currColumn);
+            if (m_currColumn + 1 == m_document.columnCount() && length == m_postion)
                 break;
-            if (m_postion == s.length()) {
-                QString ls = m_textList.at(m_currColumn + 1);
-                QList<SCharFormat> lsf = m_charFormats.at(m_currColumn + 1);
-                m_textList[m_currColumn] = s + ls;
-                sf.append(lsf);
-                m_charFormats[m_currColumn].swap(sf);
-                m_textList.removeAt(m_currColumn + 1);
-                m_charFormats.removeAt(m_currColumn + 1);
-                m_cols--;
+
+            QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+            pushUndo(command);
+
+            if (m_postion == length) {
+                //与下一列合并
+                removeRange(m_currColumn, m_postion, m_currColumn + 1, 0);
             } else {
-                s.remove(m_postion, 1);
-                sf.erase(sf.begin() + m_postion, sf.begin() + m_postion + 1);
-                m_textList[m_currColumn] = s;
-                m_charFormats[m_currColumn].swap(sf);
+                removeRange(m_currColumn, m_postion, m_currColumn, m_boundaries.nextGrapheme(m_currColumn, m_postion));
             }
         }while (0);
-        scene()->update();
         goto accept;
     } else if (e->key() == Qt::Key_Home) {
         m_postion = 0;
         m_selectedRegion->clean();
         goto accept;
     } else if (e->key() == Qt::Key_End) {
-        QString s = m_textList.at(m_currColumn);
-        m_postion = s.length();
+        m_postion = m_document.columnLength(m_currColumn);
         m_selectedRegion->clean();
         goto accept;
     } else if (e->key() == Qt::Key_Left) {
-        do {
-            if (m_oriection == TextVertical) {
-                if (m_currColumn + 1 >= m_cols)
-                    break;
-                QString ls = m_textList.at(m_currColumn + 1);
-                if (ls.length() < m_postion) {
-                    m_postion = ls.length();
-                }
-                m_currColumn++;
-            } else {
-                if (m_postion == 0 && m_currColumn == 0)
-                    break;
-                if (m_postion == 0) {
-                    m_currColumn--;
-                    m_postion = m_textList.at(m_currColumn).length();
-                } else {
-                    m_postion--;
-                }
-            }
-        }while(0);
+        //竖排时列从右向左排列
+        if (m_oriection == TextVertical) {
+            if (m_currColumn + 1 < m_document.columnCount())
+                moveToColumn(m_currColumn + 1);
+        } else {
+            moveBackward(e->modifiers() & Qt::ControlModifier);
+        }
         m_selectedRegion->clean();
         goto accept;
     } else if (e->key() == Qt::Key_Right) {
-        do {
-            if (m_oriection == TextVertical) {
-                if (m_currColumn == 0)
-                    break;
-                QString rs = m_textList.at(m_currColumn - 1);
-                if (m_postion > rs.length()) {
-                    m_postion = rs.length();
-                }
-                m_currColumn--;
-            } else {
-                QString s = m_textList.at(m_currColumn);
-                if (m_postion == s.length() && m_currColumn + 1 == m_cols)
-                    break;
-                if (m_postion == s.length()) {
-                    m_currColumn++;
-                    m_postion = 0;
-                } else {
-                    m_postion++;
-                }
-            }
-
-        }while(0);
+        if (m_oriection == TextVertical) {
+            if (m_currColumn > 0)
+                moveToColumn(m_currColumn - 1);
+        } else {
+            moveForward(e->modifiers() & Qt::ControlModifier);
+        }
         m_selectedRegion->clean();
         goto accept;
     } else if (e->key() == Qt::Key_Up) {
-        do {
-            if (m_oriection == TextVertical) {
-                if (m_postion == 0 && m_currColumn == 0)
-                    break;
-                if (m_postion == 0) {
-                    m_currColumn--;
-                    m_postion = m_textList.at(m_currColumn).length();
-                } else {
-                    m_postion--;
-                }
-            } else {
-                if (m_currColumn == 0)
-                    break;
-                QString rs = m_textList.at(m_currColumn - 1);
-                if (m_postion > rs.length()) {
-                    m_postion = rs.length();
-                }
-                m_currColumn--;
-            }
-
-        } while(0);
+        if (m_oriection == TextVertical) {
+            moveBackward(e->modifiers() & Qt::ControlModifier);
+        } else if (m_currColumn > 0) {
+            moveToColumn(m_currColumn - 1);
+        }
         m_selectedRegion->clean();
         goto accept;
-    }else if (e->key() == Qt::Key_Down) {
-        do {
-            if (m_oriection == TextVertical) {
-                QString s = m_textList.at(m_currColumn);
-                if (m_postion == s.length() && m_currColumn + 1 == m_cols)
-                    break;
-                if (m_postion == s.length()) {
-                    m_currColumn++;
-                    m_postion = 0;
-                } else {
-                    m_postion++;
-                }
-            } else {
-                if (m_currColumn + 1 >= m_cols)
-                    break;
-                QString ls = m_textList.at(m_currColumn + 1);
-                if (ls.length() < m_postion) {
-                    m_postion = ls.length();
-                }
-                m_currColumn++;
-            }
-
-        }while(0);
+    } else if (e->key() == Qt::Key_Down) {
+        if (m_oriection == TextVertical) {
+            moveForward(e->modifiers() & Qt::ControlModifier);
+        } else if (m_currColumn + 1 < m_document.columnCount()) {
+            moveToColumn(m_currColumn + 1);
+        }
         m_selectedRegion->clean();
         goto accept;
     }
@@ -773,21 +493,21 @@ void CGraphicsEdit::keyPressEvent(QKeyEvent *e)
             return;
         }
 
-        QUndoCommand* command = new CTextChanged(this, m_textList, m_postion, m_cols, m_currColumn, m_charFormats);
-        m_undoStack->push(command);
-        //format
-        for (int i = 0; i < e->text().length(); ++i) {
-            m_charFormats[m_currColumn].insert(m_postion + i, m_textFormat);
+        if (e->text().isEmpty() || !e->text().at(0).isPrint()) {
+            e->ignore();
+            return;
         }
-        //text
-        QString currText = m_textList.at(m_currColumn);
-        currText.insert(m_postion, e->text());
-        m_textList[m_currColumn] = currText;
 
-        m_postion += e->text().length();
+        if (m_selectedRegion->selected()) {
+            deleteSelectText();
+        } else {
+            pushUndo(new CTextChanged(this, m_document, m_postion, m_currColumn));
+        }
+        insertPlainText(e->text());
         goto accept;
     }
  accept:
+    markInput(inputStart);
     e->accept();
     update();
 }
@@ -799,20 +519,14 @@ void CGraphicsEdit::keyReleaseEvent(QKeyEvent *event)
 
 void CGraphicsEdit::inputMethodEvent(QInputMethodEvent *event)
 {
-    if (event->commitString().length() > 0) {
-        QUndoCommand* command = new CTextChanged(this, m_textList, m_postion, m_cols, m_currColumn, m_charFormats);
-        m_undoStack->push(command);
-
-        //format
-        for (int i = 0; i < event->commitString().length(); ++i) {
-            m_charFormats[m_currColumn].insert(m_postion + i, m_textFormat);
+    if (event->commitString().length() > 0 && !isReadOnly()) {
+        markInput(m_clock.nsecsElapsed());
+        if (m_selectedRegion->selected()) {
+            deleteSelectText();
+        } else {
+            pushUndo(new CTextChanged(this, m_document, m_postion, m_currColumn));
         }
-        //text
-        QString currText = m_textList.at(m_currColumn);
-        currText.insert(m_postion, event->commitString());
-        m_textList[m_currColumn] = currText;
-        m_postion += event->commitString().length();
-        scene()->update();
+        insertPlainText(event->commitString());
     }
 }
 
@@ -824,7 +538,7 @@ void CGraphicsEdit::onTimeout()
 
 bool CGraphicsEdit::sceneEvent(QEvent *event)
 {
-    qDebug() << "sceneEvent: " << event->type();
+    qCDebug(lcTraceEvent) << "sceneEvent:" << event->type();
     QEvent::Type t = event->type();
     if (t == QEvent::KeyPress || t == QEvent::KeyRelease) {
         int k = ((QKeyEvent *)event)->key();
@@ -913,7 +627,7 @@ void CGraphicsEdit::processEvent(QEvent* e)
             focusEvent(static_cast<QFocusEvent *>(e));
             break;
         case QEvent::ShortcutOverride:
-            if (interactionFlags & Qt::TextEditable) {
+            if ((interactionFlags & Qt::TextEditable) && !isReadOnly()) {
                 QKeyEvent* ke = static_cast<QKeyEvent *>(e);
                 if (isCommonTextEditShortcut(ke))
                     ke->accept();
@@ -933,6 +647,7 @@ void CGraphicsEdit::focusEvent(QFocusEvent* e)
     }
 }
 
+
 void CGraphicsEdit::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
     do {
@@ -940,94 +655,8 @@ void CGraphicsEdit::mousePressEvent(QGraphicsSceneMouseEvent *event)
             break;
         m_mousePressed = true;
         m_timer->stop();
-        QPointF p = event->pos();
-        const QRectF r = boundingRect();
-        const qreal adjust = 5.0;
-        qDebug() << "boundingRECT:" << r;
-        for (int i = 0; i < m_cols; i++) {
-            if (m_oriection == TextVertical) {
-                qreal rx = r.right() - adjust - (i == 0 ? 0 : getColXPostion(i - 1));
-                qreal lx = r.right() - adjust - getColXPostion(i);
-                if (p.x() <= rx && p.x() > lx) {
-                    m_currColumn = i;
-                    //计算y坐标位置
-                    qreal y = r.top() + adjust;
-                    QString s = m_textList.at(i);
-                    if (m_alignment == AlignmentCenter) {
-                        qreal textHeight = getStrHeight(i);
-                        y = -textHeight/2;
-                    } else if (m_alignment == AlignmentBottom) {
-                        qreal textHeight = getStrHeight(i);
-                        y = r.bottom() - adjust - textHeight;
-                    }
-
-                    if (s.isEmpty() || p.y() < y) {
-                        m_postion = 0;
-                    } else {
-                        for (int n = 0; n < s.length(); ++n) {
-                            qreal prevY = y;
-                            SCharFormat sf = m_charFormats.at(i).at(n);
-                            QFont font;
-                            sf.setFont(&font);
-                            QFontMetricsF m(font);
-                            QChar c = s.at(n);
-                            if (c < 128) {
-                                y += m.width(c);
-                            } else {
-                                y += m.height();
-                            }
-                            y += sf.letterSpacing;
-                            if (p.y() >= prevY && p.y() < y) {
-                                m_postion = n + 1;
-                                break;
-                            }
-                        }
-                        if (s.length() > 0 && p.y() > y) {
-                            m_postion = s.length();
-                        }
-                    }
-                    break;
-                }
-            } else {
-                qreal ty = r.top() - adjust + (i == 0 ? 0 : getRowYPostion(i - 1));
-                qreal by = r.top() - adjust + getRowYPostion(i);
-                if (p.y() >= ty && p.y() < by) {
-                    m_currColumn = i;
-                    //计算x坐标位置
-                    qreal x = r.left() + adjust;
-                    QString s = m_textList.at(i);
-                    if (m_alignment == AlignmentRight) {
-                        qreal textWidth = getStrWidth(i);
-                        x = r.right() - adjust - textWidth;
-                    } else if (m_alignment == AlignmentHCenter) {
-                        qreal textWidth = getStrWidth(i);
-                        x = r.left() + adjust + textWidth/2;
-                    }
-
-                    if (s.isEmpty() || p.x() < x) {
-                        m_postion = 0;
-                    } else {
-                        for (int n = 0; n < s.length(); ++n) {
-                            qreal prevx = x;
-                            SCharFormat sf = m_charFormats.at(i).at(n);
-                            QFont font;
-                            sf.setFont(&font);
-                            QFontMetricsF m(font);
-                            QChar c = s.at(n);
-                            x += m.width(c) + sf.letterSpacing;
-                            if (p.x() >= prevx && p.x() < x) {
-                                m_postion = n;
-                                break;
-                            }
-                        }
-                        if (s.length() > 0 && p.x() > x) {
-                            m_postion = s.length();
-                        }
-                    }
-                    break;
-                }
-            }
-        }
+        m_layout.hitTest(event->pos(), &m_currColumn, &m_postion);
+        m_postion = m_boundaries.alignToGrapheme(m_currColumn, m_postion);
         m_selectedRegion->setStartCol(m_currColumn);
         m_selectedRegion->setEndCol(m_currColumn);
         m_selectedRegion->setStartPos(m_postion);
@@ -1039,93 +668,8 @@ void CGraphicsEdit::mousePressEvent(QGraphicsSceneMouseEvent *event)
 void CGraphicsEdit::mouseMoveEvent(QGraphicsSceneMouseEvent *event)
 {
     if (m_mousePressed) {
-        QPointF p = event->pos();
-        const QRectF r = boundingRect();
-        const qreal adjust = 5.0;
-        for (int i = 0; i < m_cols; i++) {
-            if (m_oriection == TextVertical) {
-                qreal rx = r.right() - adjust - (i == 0 ? 0 : getColXPostion(i - 1));
-                qreal lx = r.right() - adjust - getColXPostion(i);
-                if (p.x() <= rx && p.x() > lx) {
-                    m_currColumn = i;
-                    //计算y坐标位置
-                    qreal y = r.top() + adjust;
-                    QString s = m_textList.at(i);
-                    if (m_alignment == AlignmentCenter) {
-                        qreal textHeight = getStrHeight(i);
-                        y = -textHeight/2;
-                    } else if (m_alignment == AlignmentBottom) {
-                        qreal textHeight = getStrHeight(i);
-                        y = r.bottom() - adjust - textHeight;
-                    }
-
-                    if (s.isEmpty() || p.y() < y) {
-                        m_postion = 0;
-                    } else {
-                        for (int n = 0; n < s.length(); ++n) {
-                            qreal prevY = y;
-                            SCharFormat sf = m_charFormats.at(i).at(n);
-                            QFont font;
-                            sf.setFont(&font);
-                            QFontMetricsF m(font);
-                            QChar c = s.at(n);
-                            if (c < 128) {
-                                y += m.width(c);
-                            } else {
-                                y += m.height();
-                            }
-                            y += sf.letterSpacing;
-                            if (p.y() >= prevY && p.y() < y) {
-                                m_postion = n;
-                                break;
-                            }
-                        }
-                        if (s.length() > 0 && p.y() > y) {
-                            m_postion = s.length();
-                        }
-                    }
-                    break;
-                }
-            } else {
-                qreal ty = r.top() - adjust + (i == 0 ? 0 : getRowYPostion(i - 1));
-                qreal by = r.top() - adjust + getRowYPostion(i);
-                if (p.y() >= ty && p.y() < by) {
-                    m_currColumn = i;
-                    //计算x坐标位置
-                    qreal x = r.left() + adjust;
-                    QString s = m_textList.at(i);
-                    if (m_alignment == AlignmentRight) {
-                        qreal textWidth = getStrWidth(i);
-                        x = r.right() - adjust - textWidth;
-                    } else if (m_alignment == AlignmentHCenter) {
-                        qreal textWidth = getStrWidth(i);
-                        x = r.left() + adjust + textWidth/2;
-                    }
-
-                    if (s.isEmpty() || p.x() < x) {
-                        m_postion = 0;
-                    } else {
-                        for (int n = 0; n < s.length(); ++n) {
-                            qreal prevx = x;
-                            SCharFormat sf = m_charFormats.at(i).at(n);
-                            QFont font;
-                            sf.setFont(&font);
-                            QFontMetricsF m(font);
-                            QChar c = s.at(n);
-                            x += m.width(c) + sf.letterSpacing;
-                            if (p.x() >= prevx && p.x() < x) {
-                                m_postion = n + 1;
-                                break;
-                            }
-                        }
-                        if (s.length() > 0 && p.x() > x) {
-                            m_postion = s.length();
-                        }
-                    }
-                    break;
-                }
-            }
-        }
+        m_layout.hitTest(event->pos(), &m_currColumn, &m_postion);
+        m_postion = m_boundaries.alignToGrapheme(m_currColumn, m_postion);
         m_selectedRegion->setEndCol(m_currColumn);
         m_selectedRegion->setEndPos(m_postion);
         update();
@@ -1143,23 +687,15 @@ void CGraphicsEdit::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 void CGraphicsEdit::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
 {
     if (interactionFlags == Qt::TextEditorInteraction) {
-        QPointF p = event->pos();
-        const QRectF r = boundingRect();
-        const qreal adjust = 5.0;
-        for (int i = 0; i < m_cols; i++) {
-            qreal rx = r.right() - adjust - (i == 0 ? 0 : getColXPostion(i - 1));
-            qreal lx = r.right() - adjust - getColXPostion(i);
-            if (p.x() <= rx && p.x() > lx) {
-                m_currColumn = i;
-                break;
-            }
-        }
-
-        int sl = m_textList.at(m_currColumn).length();
-        if (sl > 0)
-            updateSelectedText(m_currColumn, m_currColumn, 0,  sl);
+        int pos;
+        m_layout.hitTest(event->pos(), &m_currColumn, &pos);
+        //选中双击处的单词
+        int start, end;
+        m_boundaries.wordAt(m_currColumn, pos, &start, &end);
+        if (end > start)
+            updateSelectedText(m_currColumn, m_currColumn, start, end);
         else
-            m_postion = 0;
+            m_postion = start;
     } else {
         setTextInteractionFlags(Qt::TextEditorInteraction);
         m_postion = 0;
@@ -1194,26 +730,35 @@ bool CGraphicsEdit::isCommonTextEditShortcut(QKeyEvent* e)
     return true;
 }
 
+
 void CGraphicsEdit::selectAll()
 {
-    updateSelectedText(0, m_cols - 1, 0, m_textList.at(m_cols - 1).length());
+    const int last = m_document.columnCount() - 1;
+    updateSelectedText(0, last, 0, m_document.columnLength(last));
 }
 
 void CGraphicsEdit::copy()
 {
     if (m_selectedRegion->selected()) {
-        QString text = getSelectedText();
-        QGuiApplication::clipboard()->setText(text);
+        //只保存快照，内容在粘贴方请求时生成
+        QGuiApplication::clipboard()->setMimeData(new CSelectionMimeData(m_document, selectedRange()));
     }
 }
 
 void CGraphicsEdit::undo()
 {
+    //涉及已移出的列的命令不能撤销，也就不能再撤销到更早的状态
+    const int i = m_undoStack->index();
+    if (i > 0 && !static_cast<const CEditCommand*>(m_undoStack->command(i - 1))->canUndo())
+        return;
     m_undoStack->undo();
 }
 
 void CGraphicsEdit::redo()
 {
+    const int i = m_undoStack->index();
+    if (i < m_undoStack->count() && !static_cast<const CEditCommand*>(m_undoStack->command(i))->canRedo())
+        return;
     m_undoStack->redo();
 }
 
@@ -1221,134 +766,130 @@ void CGraphicsEdit::cut()
 {
     copy();
     deleteSelectText();
-    scene()->update();
 }
 
-void CGraphicsEdit::paste(QClipboard::Mode)
+void CGraphicsEdit::paste(QClipboard::Mode mode)
 {
-    QString text = QGuiApplication::clipboard()->text();
-    do {
-        if (text.isEmpty())
-            break;
-        QStringList textList = text.split(QChar('\n'));
-        QString lastStr = m_textList.at(m_currColumn);
-        QString lstr = lastStr.left(m_postion);
-        QString rstr = lastStr.right(lastStr.length() - m_postion);
-        if (textList.size() == 1) {
-            m_textList[m_currColumn] = lstr + textList.at(0) + rstr;
-            m_postion += textList.at(0).length();
-        } else {
-            for (int i = 0; i < textList.size(); ++i) {
-                if (i == 0)
-                    m_textList[m_currColumn] = lstr + textList.at(i);
-                else if (i == textList.size() - 1) {
-                    m_textList.insert(m_currColumn + i, textList.at(i) + rstr);
-                    m_postion = textList.at(i).length();
-                } else {
-                    m_textList.insert(m_currColumn + i, textList.at(i));
-                }
-            }
-            m_cols += textList.size() - 1;
-            m_currColumn += textList.size() - 1;
-        }
-    }while(0);
-    scene()->update();
+    const QMimeData* md = QGuiApplication::clipboard()->mimeData(mode);
+    if (!md)
+        return;
+    TRACE_SCOPE(lcTraceImport, "CGraphicsEdit::paste");
+    //先整体转换为文档，再一次插入
+    VerticalTextDocument doc;
+    if (md->hasHtml()) {
+        doc = VerticalTextDocument::fromHtml(md->html());
+    } else if (md->hasText()) {
+        const QString text = md->text();
+        doc.append(QStringView(text), m_textFormatId);
+    }
+    if (doc.isEmpty())
+        return;
+
+    //替换选中文字时只记录一个快照（按块共享，不复制文字），删除和插入一起撤销
+    if (m_selectedRegion->selected()) {
+        pushUndo(new CTextChanged(this, m_document, m_postion, m_currColumn));
+        const STextRange r = selectedRange();
+        removeRange(r.startCol, r.startPos, r.endCol, r.endPos);
+        insertDocument(m_currColumn, m_postion, doc);
+        return;
+    }
+    const int col = m_currColumn;
+    const int pos = m_postion;
+    insertDocument(col, pos, doc);
+    pushUndo(new CTextInserted(this, col, pos, m_currColumn, m_postion, doc));
 }
 
-QString CGraphicsEdit::getSelectedText() const
+void CGraphicsEdit::deleteSelectText()
 {
-    QString s;
-    do {
-        if (!m_selectedRegion->selected())
-            break;
-        const int startCol = m_selectedRegion->startCol();
-        const int endCol = m_selectedRegion->endCol();
-        const int startPos = m_selectedRegion->startPos();
-        const int endPos = m_selectedRegion->endPos();
-        if (startCol != endCol) {
-            for (int i = startCol; i <= endCol; ++i) {
-                QString str = m_textList.at(i);
-                if (i == startCol) {
-                    s += str.right(str.length() - startPos);
-                    s.append(QChar('\n'));
-                }
-                else if (i == endCol)
-                    s += str.left(endPos);
-                else {
-                    s += str;
-                    s.append(QChar('\n'));
-                }
-            }
-        } else {
-            QString str = m_textList.at(startCol);
-            s = str.right(str.length() - startPos).left(endPos - startPos);
-        }
+    if (m_selectedRegion->selected()) {
+        QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+        pushUndo(command);
 
-    }while(0);
-    return s;
+        const STextRange r = selectedRange();
+        removeRange(r.startCol, r.startPos, r.endCol, r.endPos);
+    }
 }
 
-void CGraphicsEdit::deleteSelectText()
+void CGraphicsEdit::removeRange(int startCol, int startPos, int endCol, int endPos)
 {
-    if (m_selectedRegion->selected()) {
-        QUndoCommand* command = new CTextChanged(this, m_textList, m_postion, m_cols, m_currColumn, m_charFormats);
-        m_undoStack->push(command);
-
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        QString headStr, tailStr;
-        QList<SCharFormat> headFormats, tailFormats;
-        if (startCol != endCol) {
-            headStr = m_textList.at(startCol).left(startPos);
-            int l = m_textList.at(endCol).length();
-            tailStr = m_textList.at(endCol).right(l - endPos);
-            for (int i = 0; i < startPos; i++) {
-                headFormats.push_back(m_charFormats.at(startCol).at(i));
-            }
+    STextRange r;
+    r.startCol = startCol;
+    r.startPos = startPos;
+    r.endCol = endCol;
+    r.endPos = endPos;
+    m_document.remove(r);
+    m_postion = startPos;
+    m_currColumn = startCol;
+    m_selectedRegion->clean();
+    documentChanged(startCol, endCol - startCol + 1, 1);
+}
 
-            for (int i = endPos; i < m_charFormats.at(endCol).size(); i++) {
-                tailFormats.push_back(m_charFormats.at(endCol).at(i));
-            }
-        }
-        for (int i = startCol; i <= endCol; ++i) {
-            QString s = m_textList.at(i);
-            QList<SCharFormat> sf = m_charFormats.at(i);
-            int ep = (i != endCol ? s.length() : endPos);
-            int bp = (i != startCol ? 0 : startPos);
-            if (startCol != endCol) {
-                if ((ep == s.length() && bp == 0) || i == endCol) {
-                    if (i == endCol) {
-                        m_textList[startCol] = headStr + tailStr;
-                        headFormats.append(tailFormats);
-                        m_charFormats[startCol] = headFormats;
-                    }
-                    m_textList.removeAt(i);
-                    m_charFormats.removeAt(i);
-                    endCol--;
-                    m_cols--;
-                    i--;
-                }
-            } else {
-                s.remove(bp, ep - bp);
-                m_textList[i] = s;
-                sf.erase(sf.begin() + bp, sf.begin() + ep);
-                m_charFormats[i].swap(sf);
-            }
+void CGraphicsEdit::insertDocument(int col, int pos, const VerticalTextDocument& doc)
+{
+    m_document.insert(col, pos, doc, &m_currColumn, &m_postion);
+    m_selectedRegion->clean();
+    documentChanged(col, 1, doc.columnCount());
+}
+
+void CGraphicsEdit::insertPlainText(const QString& text)
+{
+    VerticalTextDocument doc;
+    doc.append(QStringView(text), m_textFormatId);
+    insertDocument(m_currColumn, m_postion, doc);
+}
+
+void CGraphicsEdit::moveBackward(bool word)
+{
+    if (m_postion == 0) {
+        if (m_currColumn > 0) {
+            m_currColumn--;
+            m_postion = m_document.columnLength(m_currColumn);
         }
+        return;
+    }
+    m_postion = (word ? m_boundaries.previousWord(m_currColumn, m_postion)
+                      : m_boundaries.previousGrapheme(m_currColumn, m_postion));
+}
 
-        if (m_textList.size() == 0) {
-            m_textList << QString("");
-            QList<SCharFormat> sf;
-            m_charFormats << sf;
-            m_cols = 1;
+void CGraphicsEdit::moveForward(bool word)
+{
+    if (m_postion >= m_document.columnLength(m_currColumn)) {
+        if (m_currColumn + 1 < m_document.columnCount()) {
+            m_currColumn++;
+            m_postion = 0;
         }
-        m_postion = startPos;
-        m_currColumn = startCol;
-        m_selectedRegion->clean();
+        return;
     }
+    m_postion = (word ? m_boundaries.nextWord(m_currColumn, m_postion)
+                      : m_boundaries.nextGrapheme(m_currColumn, m_postion));
+}
+
+void CGraphicsEdit::moveToColumn(int col)
+{
+    m_currColumn = col;
+    m_postion = m_boundaries.alignToGrapheme(col, qMin(m_postion, m_document.columnLength(col)));
+}
+
+void CGraphicsEdit::documentChanged(int first, int removed, int inserted)
+{
+    m_layout.columnsChanged(first, removed, inserted);
+    m_boundaries.columnsChanged(first, removed, inserted);
+    updateMatches(first, removed, inserted);
+    prepareGeometryChange();
+    update();
+}
+
+STextRange CGraphicsEdit::selectedRange() const
+{
+    STextRange r;
+    if (!m_selectedRegion->selected())
+        return r;
+    r.startCol = m_selectedRegion->startCol();
+    r.endCol = m_selectedRegion->endCol();
+    r.startPos = m_selectedRegion->startPos();
+    r.endPos = m_selectedRegion->endPos();
+    if (r.startCol == r.endCol && r.startPos > r.endPos) qSwap(r.startPos, r.endPos);
+    return r;
 }
 
 void CGraphicsEdit::updateSelectedText(int beginCol, int endCol, int beginPos, int endPos)
@@ -1361,43 +902,22 @@ void CGraphicsEdit::updateSelectedText(int beginCol, int endCol, int beginPos, i
 
 QString CGraphicsEdit::text() const
 {
-    QString s;
-    for (int i = 0; i < m_textList.size(); i++) {
-        s += m_textList.at(i);
-        if (i != m_textList.size() - 1) {
-            s.append(QChar('\n'));
-        }
-    }
-    return s;
+    return m_document.toPlainText();
 }
 
-void CGraphicsEdit::updateData(const QStringList& sl, int cols, int pos, int currCol, const QList<QList<SCharFormat>>& sf)
+void CGraphicsEdit::updateData(const VerticalTextDocument& doc, int pos, int currCol)
 {
-    QStringList nl = sl;
-    if (nl.size() == 0) {
-        nl << QString("");
-        m_textList.swap(nl);
-        QList<SCharFormat> lsf;
-        m_charFormats.erase(m_charFormats.begin(), m_charFormats.end());
-        m_charFormats << lsf;
-        m_cols = 1;
-        m_postion = 0;
-        m_currColumn = 0;
-    } else {
-        m_textList.swap(nl);
-        m_cols = m_textList.size();
-        m_postion = pos;
-        m_currColumn = currCol;
-        m_charFormats.erase(m_charFormats.begin(), m_charFormats.end());
-        for (int i = 0; i < sf.size(); i++) {
-            QList<SCharFormat> lsf;
-            for(int j = 0; j < sf.at(i).size(); j++) {
-                lsf.push_back(sf.at(i).at(j));
-            }
-            m_charFormats << lsf;
-        }
-    }
-    scene()->update();
+    const bool wasMapped = m_document.isMapped();
+    m_document = doc;
+    leaveMappedFile(wasMapped);
+    m_currColumn = qBound(0, currCol, m_document.columnCount() - 1);
+    m_postion = qBound(0, pos, m_document.columnLength(m_currColumn));
+    m_selectedRegion->clean();
+    m_layout.invalidate();
+    m_boundaries.invalidate();
+    m_matchesValid = false;
+    prepareGeometryChange();
+    update();
 }
 
 void CGraphicsEdit::setAlignment(TextAlignment d)
@@ -1410,336 +930,110 @@ void CGraphicsEdit::setAlignment(TextAlignment d)
             return;
     }
     m_alignment = d;
-    scene()->update();
-}
-
-qreal CGraphicsEdit::getStrHeight(int index) const
-{
-    QString str = m_textList.at(index);
-    qreal h = 0;
-    for (int i = 0; i < str.length(); ++i) {
-        SCharFormat f = m_charFormats.at(index).at(i);
-        QFont font;
-        f.setFont(&font);
-        QFontMetricsF m(font);
-        if (str[i] < 128) {
-            h += m.width(str[i]);
-        } else {
-            h += m.height();
-        }
-        if (i != str.length() - 1) {
-            h += f.letterSpacing;
-        }
-    }
-    return h;
+    m_layout.setAlignment(d);
+    update();
 }
 
-qreal CGraphicsEdit::getStrWidth(int index) const
+void CGraphicsEdit::beginFormatChange()
 {
-    QString str = m_textList.at(index);
-    qreal w = 0;
-    for (int i = 0; i < str.length(); ++i) {
-        SCharFormat f = m_charFormats.at(index).at(i);
-        QFont font;
-        f.setFont(&font);
-        QFontMetricsF m(font);
-        w += m.width(str[i]);
-        if (i != str.length() - 1) {
-            w += f.letterSpacing;
-        }
-    }
-    return w;
+    if (m_formatChanging)
+        return;
+    m_formatChanging = true;
+    m_formatChanged = false;
+    m_formatUndo = new CTextChanged(this, m_document, m_postion, m_currColumn);
 }
 
-qreal CGraphicsEdit::getColWidth(int index) const
+void CGraphicsEdit::endFormatChange()
 {
-    qreal colWidth = 0;
-    QString s = m_textList.at(index);
-    if (s.isEmpty()) {
-        QFont font;
-        m_textFormat.setFont(&font);
-        QFontMetricsF m(font);
-        colWidth = m.height() > m.maxWidth() ? m.height() : m.maxWidth();
+    if (!m_formatChanging)
+        return;
+    m_formatChanging = false;
+    //整个交互只记录一次撤销
+    if (m_formatChanged) {
+        pushUndo(m_formatUndo);
     } else {
-        for (int i = 0; i < s.size(); ++i) {
-            SCharFormat f = m_charFormats.at(index).at(i);
-            QFont font;
-            f.setFont(&font);
-            QFontMetricsF m(font);
-            qreal w = m.height() > m.maxWidth() ? m.height() : m.maxWidth();
-            if (w > colWidth) {
-                colWidth = w;
-            }
-        }
+        delete m_formatUndo;
     }
-    return colWidth;
+    m_formatUndo = nullptr;
+    m_formatChanged = false;
 }
 
-qreal CGraphicsEdit::getColXPostion(int index) const
+template<typename Fn>
+void CGraphicsEdit::applyFormat(Fn fn)
 {
-    qreal x = 0;
-    for (int i = 0; i <= index; ++i) {
-        QString s = m_textList.at(i);
-        if (s.isEmpty()) {
-            QFont font;
-            m_textFormat.setFont(&font);
-            QFontMetricsF m(font);
-            qreal colWidth = m.height() > m.maxWidth() ? m.height() : m.maxWidth();
-            x += colWidth;
-        } else {
-            qreal colWidth = 0;
-            int size = s.size() > m_charFormats.at(i).size() ? m_charFormats.at(i).size() : s.size();
-            for (int j = 0; j < size; ++j) {
-                SCharFormat f = m_charFormats.at(i).at(j);
-                QFont font;
-                f.setFont(&font);
-                QFontMetricsF m(font);
-                qreal w = m.height() > m.maxWidth() ? m.height() : m.maxWidth();
-                if (w > colWidth) {
-                    colWidth = w;
-                }
-            }
-            x += colWidth;
-        }
-    }
-
-    if (m_cols > 1) {
-        x += (m_cols - 1)*m_columnSpacing;
+    if (!m_selectedRegion->selected()) {
+        fn(m_textFormat);
+        m_textFormatId = CFormatRegistry::intern(m_textFormat);
+        m_layout.setEmptyColumnFormat(m_textFormatId);
+        prepareGeometryChange();
+        update();
+        return;
     }
 
-    return x;
-}
-
-qreal CGraphicsEdit::getRowHeight(int index) const
-{
-    qreal h = 0;
-    QString s = m_textList.at(index);
-    if (s.isEmpty()) {
-        QFont font;
-        m_textFormat.setFont(&font);
-        QFontMetricsF m(font);
-        h = m.height();
+    if (isReadOnly())
+        return;
+    if (m_formatChanging) {
+        m_formatChanged = true;
     } else {
-        int size = s.size() > m_charFormats.at(index).size() ? m_charFormats.at(index).size() : s.size();
-        for (int j = 0; j < size; ++j) {
-            SCharFormat f = m_charFormats.at(index).at(j);
-            QFont font;
-            f.setFont(&font);
-            QFontMetricsF m(font);
-            if (m.height() > h) {
-                h = m.height();
-            }
-        }
+        QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+        pushUndo(command);
     }
-    return h;
-}
 
-qreal CGraphicsEdit::getRowYPostion(int index) const
-{
-    qreal y = 0;
-    for (int i = 0; i <= index; ++i) {
-        QString s = m_textList.at(i);
-        if (s.isEmpty()) {
-            QFont font;
-            m_textFormat.setFont(&font);
-            QFontMetricsF m(font);
-            qreal h = m.height();
-            y += h;
-        } else {
-            qreal h = 0;
-            int size = s.size() > m_charFormats.at(i).size() ? m_charFormats.at(i).size() : s.size();
-            for (int j = 0; j < size; ++j) {
-                SCharFormat f = m_charFormats.at(i).at(j);
-                QFont font;
-                f.setFont(&font);
-                QFontMetricsF m(font);
-                if (m.height() > h) {
-                    h = m.height();
-                }
-            }
-            y += h;
-        }
-    }
-
-    if (m_cols > 1) {
-        y += (m_cols - 1)*m_columnSpacing;
-    }
-
-    return y;
+    const STextRange r = selectedRange();
+    m_document.updateFormats(r, fn);
+    //只重新计算选中的列，只重绘本项
+    const int count = r.endCol - r.startCol + 1;
+    documentChanged(r.startCol, count, count);
 }
 
 void CGraphicsEdit::onFontChanged(const QString& text)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.fontText = text;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].fontText = text;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.fontText = text; });
 }
 
 void CGraphicsEdit::setBold(bool enabled)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.bold = enabled;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].bold = enabled;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.bold = enabled; });
 }
 
 void CGraphicsEdit::setItalic(bool enabled)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.italic = enabled;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].italic = enabled;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.italic = enabled; });
 }
 
 void CGraphicsEdit::setOverline(bool enabled)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.overline = enabled;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].overline = enabled;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.overline = enabled; });
 }
 
 void CGraphicsEdit::setUnderline(bool enabled)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.underline = enabled;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].underline = enabled;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.underline = enabled; });
 }
 
 void CGraphicsEdit::setFontSize(int size)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.fontSize = size;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].fontSize = size;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.fontSize = size; });
 }
 
 void CGraphicsEdit::setStrikeOut(bool enabled)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.strikeOut = enabled;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].strikeOut = enabled;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.strikeOut = enabled; });
 }
 
 void CGraphicsEdit::setColumnSpacing(qreal spacing)
 {
-    m_columnSpacing = spacing;
-    scene()->update();
+    //列间距对整个文档生效，连续修改期间总是记录撤销
+    if (m_formatChanging)
+        m_formatChanged = true;
+    m_layout.setColumnSpacing(spacing);
+    prepareGeometryChange();
+    update();
 }
 
 void CGraphicsEdit::setLetterSpacing(qreal spacing)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.letterSpacing = spacing;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].letterSpacing = spacing;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.letterSpacing = spacing; });
 }
 
 void CGraphicsEdit::setTextOriection(TextOriection oriection)
@@ -1750,57 +1044,21 @@ void CGraphicsEdit::setTextOriection(TextOriection oriection)
     } else {
         m_alignment = AlignmentLeft;
     }
-    scene()->update();
+    prepareGeometryChange();
+    m_layout.setOrientation(oriection == TextVertical ? VerticalTextLayout::Vertical : VerticalTextLayout::Horizontal);
+    m_layout.setAlignment(m_alignment);
+    update();
 }
 
 void CGraphicsEdit::onColorSelected(const QColor &color)
 {
-    if (!m_selectedRegion->selected()) {
-        m_textFormat.fontColor = color;
-    } else {
-        const int startCol = m_selectedRegion->startCol();
-        int endCol = m_selectedRegion->endCol();
-        int startPos = m_selectedRegion->startPos();
-        int endPos = m_selectedRegion->endPos();
-        if (startCol == endCol && startPos > endPos) qSwap(startPos, endPos);
-        for (int i = startCol; i <= endCol; ++i) {
-            int bp = (i == startCol ? startPos : 0);
-            int ep = (i == endCol ? endPos : m_charFormats.at(i).length());
-            for (int j = bp; j < ep; ++j) {
-                m_charFormats[i][j].fontColor = color;
-            }
-        }
-    }
-    scene()->update();
+    applyFormat([&](SCharFormat& sf) { sf.fontColor = color; });
 }
 
 QString CGraphicsEdit::toHtml() const
 {
-    QString htmlStr;
-    //先清空
-    m_textItem->setHtml("");
-
-    QTextCursor cursor = m_textItem->textCursor();
-    for (int i = 0; i < m_textList.size(); ++i) {
-        QString s = m_textList.at(i);
-        for(int j = 0; j < s.length(); ++j) {
-            QTextCharFormat tf;
-            SCharFormat sf = m_charFormats.at(i).at(j);
-            QFont font;
-            sf.setFont(&font);
-            tf.setFont(font);
-            tf.setForeground(sf.fontColor);
-            cursor.insertText(s.at(j), tf);
-        }
-        if (i != m_textList.size() - 1)
-            cursor.insertText("\n");
-    }
-    QTextBlockFormat blockFormat = cursor.blockFormat();
-    blockFormat.setLineHeight(m_columnSpacing, QTextBlockFormat::LineDistanceHeight);
-    cursor.setBlockFormat(blockFormat);
-    m_textItem->setTextCursor(cursor);
-    htmlStr = m_textItem->toHtml(); 
-    return htmlStr;
+    TRACE_SCOPE(lcTraceExport, "CGraphicsEdit::toHtml");
+    return m_document.toHtml(m_layout.columnSpacing());
 }
 
 void CGraphicsEdit::setText(const QString& text)
@@ -1808,42 +1066,501 @@ void CGraphicsEdit::setText(const QString& text)
     do{
         if (text.isEmpty())
             break;
-        //clean
-        m_cols = 1;
+        TRACE_SCOPE(lcTraceImport, "CGraphicsEdit::setText");
+        qreal spacing = 0;
+        prepareGeometryChange();
+        const bool wasMapped = m_document.isMapped();
+        m_document = VerticalTextDocument::fromHtml(text, &spacing);
+        leaveMappedFile(wasMapped);
+        //撤销栈中的命令属于原来的文档
+        m_undoStack->clear();
+        m_currColumn = m_document.columnCount() - 1;
+        m_postion = m_document.columnLength(m_currColumn);
+        m_selectedRegion->clean();
+        m_layout.setColumnSpacing(spacing);
+        m_layout.invalidate();
+        m_boundaries.invalidate();
+        m_matchesValid = false;
+        update();
+    } while(0);
+}
+
+void CGraphicsEdit::positionToColumn(int position, int* col, int* pos) const
+{
+    if (position < 0) {
+        *col = m_currColumn;
+        *pos = m_postion;
+        return;
+    }
+    m_document.columnAtOffset(position, col, pos);
+}
+
+void CGraphicsEdit::setCursorPosition(int position)
+{
+    positionToColumn(position, &m_currColumn, &m_postion);
+    m_selectedRegion->clean();
+    update();
+}
+
+void CGraphicsEdit::drawSelectionOverlay(QPainter* painter) const
+{
+    const QVector<QRectF> rects = m_layout.selectionRects(selectedRange());
+    if (rects.isEmpty())
+        return;
+    QColor color(SELECTION_OVERLAY_COLOR);
+    color.setAlpha(96);
+    painter->save();
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(color);
+    painter->drawRects(rects);
+    painter->restore();
+}
+
+bool CGraphicsEdit::drawLodPixmap(QPainter* painter, qreal scale)
+{
+    //按2的幂取整，同一缩放档位只生成一次
+    scale = qPow(2, qFloor(std::log2(scale)));
+    const QRectF r = m_layout.boundingRect();
+    const QSize size = (r.size() * scale).toSize();
+    if (size.isEmpty() || size.width() > LOD_PIXMAP_SIZE || size.height() > LOD_PIXMAP_SIZE)
+        return false;
+    if (m_lodPixmap.isNull() || m_lodRevision != m_layout.revision() || m_lodScale != scale) {
+        TRACE_SCOPE(lcTracePaint, "CGraphicsEdit::drawLodPixmap");
+        QPixmap pixmap(size);
+        pixmap.fill(Qt::transparent);
+        QPainter p(&pixmap);
+        p.setRenderHint(QPainter::TextAntialiasing);
+        p.scale(scale, scale);
+        p.translate(-r.topLeft());
+        m_layout.draw(&p, STextRange());
+        p.end();
+        m_lodPixmap = pixmap;
+        m_lodRevision = m_layout.revision();
+        m_lodScale = scale;
+    }
+    painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    painter->drawPixmap(r, m_lodPixmap, QRectF(m_lodPixmap.rect()));
+    painter->restore();
+    return true;
+}
+
+void CGraphicsEdit::setTiledRendering(bool enabled)
+{
+    if (enabled == (m_tileRenderer != nullptr))
+        return;
+    if (enabled) {
+        m_tileRenderer = new CTileRenderer(this);
+        connect(m_tileRenderer, &CTileRenderer::tileReady, this, [this](const QRectF& rect) { update(rect); });
+    } else {
+        delete m_tileRenderer;
+        m_tileRenderer = nullptr;
+    }
+    update();
+}
+
+void CGraphicsEdit::setVirtualized(bool enabled)
+{
+    //映射文件只能虚拟显示，通知界面恢复原来的状态
+    if (isReadOnly()) {
+        if (!enabled)
+            emit virtualizedChanged(true);
+        return;
+    }
+    setLayoutVirtualized(enabled);
+}
+
+void CGraphicsEdit::setLayoutVirtualized(bool enabled)
+{
+    if (enabled == m_layout.isVirtualized())
+        return;
+    prepareGeometryChange();
+    m_layout.setVirtualized(enabled);
+    m_lodPixmap = QPixmap();
+    update();
+    emit virtualizedChanged(enabled);
+}
+
+void CGraphicsEdit::leaveMappedFile(bool wasMapped)
+{
+    if (wasMapped && !m_document.isMapped())
+        setLayoutVirtualized(m_virtualizedBeforeMapped);
+}
+
+bool CGraphicsEdit::openMappedFile(const QString& fileName, QString* error)
+{
+    TRACE_SCOPE(lcTraceImport, "CGraphicsEdit::openMappedFile");
+    QSharedPointer<CMappedTextFile> file(new CMappedTextFile);
+    if (!file->open(fileName, error))
+        return false;
+    connect(file.data(), &CMappedTextFile::linesIndexed, this, &CGraphicsEdit::onLinesIndexed);
+    //先切换到虚拟显示，避免度量全部列；记下打开前的状态，换成可编辑的文档时恢复
+    if (!isReadOnly())
+        m_virtualizedBeforeMapped = m_layout.isVirtualized();
+    setLayoutVirtualized(true);
+    m_indexedLines = file->lineCount();
+    m_undoStack->clear();
+    updateData(VerticalTextDocument::fromMappedFile(file), 0, 0);
+    m_lodPixmap = QPixmap();
+    return true;
+}
+
+void CGraphicsEdit::importPlainText(QIODevice* device, const QByteArray& codecName)
+{
+    TRACE_SCOPE(lcTraceImport, "CGraphicsEdit::importPlainText");
+    //上一次导入取消，已排队的块按序号丢弃
+    delete m_importer;
+    const int generation = ++m_importGeneration;
+    m_undoStack->clear();
+    updateData(VerticalTextDocument(), 0, 0);
+    m_importer = new CTextImporter(this);
+    connect(m_importer, &CTextImporter::chunkReady, this, [this, generation](const QString& text) {
+        if (generation == m_importGeneration)
+            appendText(QStringView(text));
+    });
+    connect(m_importer, &CTextImporter::finished, this, [this, generation](bool ok, const QString& error) {
+        if (generation != m_importGeneration)
+            return;
+        m_undoStack->clear();
+        emit importFinished(ok, error);
+    });
+    m_importer->start(device, codecName);
+}
+
+bool CGraphicsEdit::isImporting() const
+{
+    return m_importer && m_importer->isRunning();
+}
+
+void CGraphicsEdit::appendText(QStringView text, int formatId)
+{
+    if (text.isEmpty() || isReadOnly())
+        return;
+    //最后一列可能接着写，和新增的列一起失效
+    const int last = m_document.columnCount() - 1;
+    m_document.append(text, validFormatId(formatId));
+    m_layout.columnsChanged(last, 1, m_document.columnCount() - last);
+    m_boundaries.columnsChanged(last, 1, m_document.columnCount() - last);
+    updateMatches(last, 1, m_document.columnCount() - last);
+    evictColumns();
+    prepareGeometryChange();
+    update();
+}
+
+int CGraphicsEdit::validFormatId(int formatId) const
+{
+    if (formatId < 0)
+        return m_textFormatId;
+    //未登记的ID读取时会静默变成默认格式，保存和导出后无法发现
+    if (formatId >= CFormatRegistry::count()) {
+        qWarning() << "CGraphicsEdit: unknown format id" << formatId;
+        return m_textFormatId;
+    }
+    return formatId;
+}
+
+void CGraphicsEdit::postAppend(const QString& text, int formatId)
+{
+    if (text.isEmpty())
+        return;
+    m_appendQueue.push(STextRun{text, formatId});
+    //队列从空变为非空时才安排一次处理，之后的追加由同一批取出
+    if (m_drainScheduled.testAndSetOrdered(0, 1)) {
+        QMetaObject::invokeMethod(this, [this]() {
+            QTimer::singleShot(APPEND_FRAME_MSECS, this, &CGraphicsEdit::drainAppends);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void CGraphicsEdit::drainAppends()
+{
+    //先清除标记，取出期间入队的文字会再安排一次
+    //必须是完整屏障：否则下面的读取可能提前到清除之前，生产者看到标记仍为1而不再安排，最后一批文字留在队列里
+    m_drainScheduled.fetchAndStoreOrdered(0);
+    STextRun run;
+    if (!m_appendQueue.tryPop(&run))
+        return;
+    TRACE_SCOPE(lcTraceLayout, "CGraphicsEdit::drainAppends");
+    const int last = m_document.columnCount() - 1;
+    const bool readOnly = isReadOnly();
+    do {
+        if (!readOnly)
+            m_document.append(QStringView(run.text), validFormatId(run.formatId));
+    } while (m_appendQueue.tryPop(&run));
+    if (readOnly)
+        return;
+    m_layout.columnsChanged(last, 1, m_document.columnCount() - last);
+    m_boundaries.columnsChanged(last, 1, m_document.columnCount() - last);
+    updateMatches(last, 1, m_document.columnCount() - last);
+    evictColumns();
+    prepareGeometryChange();
+    update();
+}
+
+void CGraphicsEdit::setMaximumColumnCount(int count)
+{
+    m_maxColumns = qMax(0, count);
+    if (isReadOnly())
+        return;
+    evictColumns();
+    prepareGeometryChange();
+    update();
+}
+
+void CGraphicsEdit::evictColumns()
+{
+    const int excess = (m_maxColumns > 0 ? m_document.columnCount() - m_maxColumns : 0);
+    if (excess <= 0)
+        return;
+    TRACE_SCOPE(lcTraceLayout, "CGraphicsEdit::evictColumns");
+    //撤销命令执行时按累计的移出列数换算列号
+    m_evictedColumns += excess;
+    m_document.removeFirstColumns(excess);
+    m_layout.columnsEvicted(excess);
+    m_boundaries.columnsChanged(0, excess, 0);
+    updateMatches(0, excess, 0);
+    if (m_currColumn < excess) {
         m_currColumn = 0;
         m_postion = 0;
-        m_charFormats.erase(m_charFormats.begin(), m_charFormats.end());
-        m_textList.erase(m_textList.begin(), m_textList.end());
-        //先通过QGraphicsTextItem转换格式
-        m_textItem->setHtml(text);
-        //set text
-        QString plainText = m_textItem->toPlainText();
-        QStringList textList = plainText.split(QChar('\n'));
-        m_textList.swap(textList);
-        m_cols += m_textList.size() - 1;
-        m_currColumn += m_textList.size() - 1;
-        m_postion = m_textList.at(m_currColumn).length();
-        //set format
-        QTextCursor cursor = m_textItem->textCursor();
-        QList<SCharFormat> nullSf;
-        m_charFormats << nullSf;
-        int i = 1;
-        for(int pos = 0; pos < plainText.length(); ++pos) {
-            if (plainText.at(pos) == QChar('\n')) {
-                i++;
-                m_charFormats << nullSf;
-                continue;
-            }
-            cursor.setPosition(pos);
-            QTextCharFormat tf = cursor.charFormat();
-            QFont f = tf.font();
-            SCharFormat sf;
-            sf.fromFont(f);
-            sf.fontColor = tf.foreground().color();
-            m_charFormats[i - 1].push_back(sf);
+    } else {
+        m_currColumn -= excess;
+    }
+    if (m_selectedRegion->selected()) {
+        if (m_selectedRegion->startCol() < excess) {
+            m_selectedRegion->clean();
+        } else {
+            m_selectedRegion->shiftColumns(excess);
         }
-        QTextBlockFormat blockFormat = cursor.blockFormat();
-        m_columnSpacing = blockFormat.lineHeight();
-        scene()->update();
-    } while(0);
+    }
+}
+
+void CGraphicsEdit::onLinesIndexed(int count)
+{
+    //信号可能来自已被替换的文件
+    if (!isReadOnly() || sender() != m_document.mappedFile())
+        return;
+    count = qMax(1, count);
+    if (count != m_indexedLines) {
+        prepareGeometryChange();
+        m_layout.columnsChanged(m_indexedLines, 0, count - m_indexedLines);
+        m_boundaries.columnsChanged(m_indexedLines, 0, count - m_indexedLines);
+        updateMatches(m_indexedLines, 0, count - m_indexedLines);
+        m_indexedLines = count;
+    }
+    update();
+}
+
+void CGraphicsEdit::pushUndo(QUndoCommand* command)
+{
+    TRACE_SCOPE(lcTraceUndo, "CGraphicsEdit::pushUndo");
+    m_undoStack->push(command);
+}
+
+void CGraphicsEdit::markInput(qint64 start)
+{
+    //连续输入只按第一次计时
+    if (m_inputStart < 0)
+        m_inputStart = start;
+}
+
+void CGraphicsEdit::setSearchPattern(const QString& pattern, Qt::CaseSensitivity cs)
+{
+    if (pattern == m_search.pattern() && cs == m_search.caseSensitivity())
+        return;
+    m_search.setPattern(pattern, cs);
+    m_matches.clear();
+    m_matchesValid = false;
+    update();
+}
+
+int CGraphicsEdit::matchCount() const
+{
+    ensureMatches();
+    return m_matches.size();
+}
+
+void CGraphicsEdit::ensureMatches() const
+{
+    if (m_matchesValid)
+        return;
+    m_matches = m_search.findAll(m_document);
+    m_matchesValid = true;
+}
+
+void CGraphicsEdit::updateMatches(int first, int removed, int inserted)
+{
+    if (!m_matchesValid || !m_search.isValid())
+        return;
+    //改动的列重新查找，之后的匹配平移列号
+    auto before = [](const STextRange& r, int col) { return r.startCol < col; };
+    const int lo = int(std::lower_bound(m_matches.constBegin(), m_matches.constEnd(), first, before) - m_matches.constBegin());
+    const int hi = int(std::lower_bound(m_matches.constBegin() + lo, m_matches.constEnd(), first + removed, before) - m_matches.constBegin());
+    QVector<STextRange> matches = m_matches.mid(0, lo);
+    for (int col = first; col < first + inserted; ++col) {
+        m_search.findInColumn(m_document, col, &matches);
+    }
+    const int shift = inserted - removed;
+    matches.reserve(matches.size() + m_matches.size() - hi);
+    for (int i = hi; i < m_matches.size(); ++i) {
+        STextRange r = m_matches.at(i);
+        r.startCol += shift;
+        r.endCol += shift;
+        matches << r;
+    }
+    m_matches = matches;
+}
+
+void CGraphicsEdit::drawMatches(QPainter* painter, const QRectF& exposed) const
+{
+    if (!m_search.isValid())
+        return;
+    ensureMatches();
+    m_layout.drawHighlights(painter, m_matches, SEARCH_HIGHLIGHT_COLOR, exposed);
+}
+
+void CGraphicsEdit::selectMatch(const STextRange& r, bool backward)
+{
+    if (backward)
+        updateSelectedText(r.endCol, r.startCol, r.endPos, r.startPos);
+    else
+        updateSelectedText(r.startCol, r.endCol, r.startPos, r.endPos);
+    const QVector<QRectF> rects = m_layout.selectionRects(r);
+    if (!rects.isEmpty())
+        ensureVisible(rects.first());
+}
+
+void CGraphicsEdit::selectRange(const STextRange& r)
+{
+    STextRange c;
+    c.startCol = qBound(0, r.startCol, m_document.columnCount() - 1);
+    c.endCol = qBound(c.startCol, r.endCol, m_document.columnCount() - 1);
+    c.startPos = qBound(0, r.startPos, m_document.columnLength(c.startCol));
+    c.endPos = qBound(0, r.endPos, m_document.columnLength(c.endCol));
+    if (c.startCol == c.endCol && c.endPos < c.startPos)
+        c.endPos = c.startPos;
+    selectMatch(c, false);
+}
+
+bool CGraphicsEdit::findNext()
+{
+    TRACE_SCOPE(lcTraceSearch, "CGraphicsEdit::findNext");
+    const STextRange r = m_search.findNext(m_document, m_currColumn, m_postion);
+    if (r.isEmpty())
+        return false;
+    selectMatch(r, false);
+    return true;
+}
+
+bool CGraphicsEdit::findPrevious()
+{
+    TRACE_SCOPE(lcTraceSearch, "CGraphicsEdit::findPrevious");
+    //从选中范围的开头向前找，避免再次找到当前选中的匹配
+    int col = m_currColumn;
+    int pos = m_postion;
+    if (m_selectedRegion->selected()) {
+        const STextRange sel = selectedRange();
+        col = sel.startCol;
+        pos = sel.startPos;
+    }
+    const STextRange r = m_search.findPrevious(m_document, col, pos);
+    if (r.isEmpty())
+        return false;
+    selectMatch(r, true);
+    return true;
+}
+
+bool CGraphicsEdit::replaceNext(const QString& after)
+{
+    bool replaced = false;
+    const STextRange sel = selectedRange();
+    if (!isReadOnly() && !after.contains(QChar('\n')) && m_search.matches(m_document, sel)) {
+        QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+        pushUndo(command);
+        CTextSearch::replaceAll(&m_document, QVector<STextRange>() << sel, after);
+        m_currColumn = sel.startCol;
+        m_postion = sel.startPos + after.size();
+        m_selectedRegion->clean();
+        documentChanged(sel.startCol, 1, 1);
+        replaced = true;
+    }
+    findNext();
+    return replaced;
+}
+
+int CGraphicsEdit::replaceAll(const QString& after)
+{
+    if (isReadOnly() || after.contains(QChar('\n')))
+        return 0;
+    ensureMatches();
+    if (m_matches.isEmpty())
+        return 0;
+    TRACE_SCOPE(lcTraceSearch, "CGraphicsEdit::replaceAll");
+    const QVector<STextRange> matches = m_matches;
+    QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+    pushUndo(command);
+    int first, last;
+    CTextSearch::replaceAll(&m_document, matches, after, &first, &last);
+    m_postion = qMin(m_postion, m_document.columnLength(m_currColumn));
+    m_selectedRegion->clean();
+    //所有替换只失效一次
+    documentChanged(first, last - first + 1, last - first + 1);
+    return matches.size();
+}
+
+SPerfStats CGraphicsEdit::perfStats() const
+{
+    SPerfStats ps;
+    ps.latencyP50 = m_latency.percentile(0.50);
+    ps.latencyP95 = m_latency.percentile(0.95);
+    ps.latencyP99 = m_latency.percentile(0.99);
+    ps.samples = m_latency.count();
+    ps.paintTime = m_paintTime / 1000;
+    const VerticalTextLayout::SStats& ls = m_layout.stats();
+    const quint64 lookups = ls.columnHits + ls.columnMisses;
+    ps.cacheHitRate = (lookups ? qreal(ls.columnHits) / lookups : 0);
+    ps.glyphs = m_frameGlyphs;
+    const CShapeCache::SStats ss = CShapeCache::stats();
+    const quint64 shapeLookups = ss.hits + ss.misses;
+    ps.shapeHitRate = (shapeLookups ? qreal(ss.hits) / shapeLookups : 0);
+    ps.shapeEntries = ss.entries;
+    ps.shapeKilobytes = ss.kilobytes;
+    return ps;
+}
+
+void CGraphicsEdit::resetPerfStats()
+{
+    m_latency.reset();
+    m_layout.resetStats();
+}
+
+void CGraphicsEdit::insertText(int position, QStringView text, int formatId)
+{
+    if (text.isEmpty() || isReadOnly())
+        return;
+    VerticalTextDocument doc;
+    doc.append(text, validFormatId(formatId));
+
+    QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+    pushUndo(command);
+    int col, pos;
+    positionToColumn(position, &col, &pos);
+    insertDocument(col, pos, doc);
+}
+
+void CGraphicsEdit::insertRuns(int position, const QVector<STextRun>& runs)
+{
+    if (isReadOnly())
+        return;
+    VerticalTextDocument doc;
+    for (const STextRun& run : runs) {
+        doc.append(QStringView(run.text), validFormatId(run.formatId));
+    }
+    if (doc.isEmpty())
+        return;
+
+    QUndoCommand* command = new CTextChanged(this, m_document, m_postion, m_currColumn);
+    pushUndo(command);
+    int col, pos;
+    positionToColumn(position, &col, &pos);
+    insertDocument(col, pos, doc);
 }
@@ -3,48 +3,40 @@
 
 #include <QGraphicsObject>
 #include <QFont>
-#include <QMutex>
 #include <QClipboard>
 #include <QUndoStack>
-#include <QGraphicsTextItem>
-#include <QTextCharFormat>
-
-typedef struct SCharFormat{
-    QString  fontText = "MicroSoft YaHei";
-    QColor   fontColor = Qt::black;
-    int      fontSize = 10;
-    bool     bold = false;
-    bool     italic = false;
-    bool     overline = false;
-    bool     underline = false;
-    bool     strikeOut = false;
-    qreal    letterSpacing = 0;
-
-    void setFont(QFont* f) const {
-        f->setFamily(fontText);
-        f->setBold(bold);
-        f->setItalic(italic);
-        f->setOverline(overline);
-        f->setPointSize(fontSize);
-        f->setUnderline(underline);
-        f->setStrikeOut(strikeOut);
-        f->setLetterSpacing(QFont::AbsoluteSpacing, letterSpacing);
-    }
-
-    void fromFont(const QFont& f) {
-        fontText = f.family();
-        fontSize = f.pointSize();
-        bold = f.bold();
-        italic = f.italic();
-        overline = f.overline();
-        underline = f.underline();
-        strikeOut = f.strikeOut();
-        letterSpacing = f.letterSpacing();
-    }
-} SCharFormat;
+#include <QStringView>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QPixmap>
+#include "verticaltextlayout.h"
+#include "clatencyhistogram.h"
+#include "cmpscqueue.h"
+#include "ctextsearch.h"
+#include "cboundaryindex.h"
 
 class QTimer;
 class SelectedRegion;
+class CTextChanged;
+class CEditCommand;
+class QUndoCommand;
+class CTileRenderer;
+class CTextImporter;
+class QIODevice;
+
+//性能统计，时间单位为微秒
+typedef struct SPerfStats{
+    qint64  latencyP50 = 0;     //输入到绘制完成的延迟
+    qint64  latencyP95 = 0;
+    qint64  latencyP99 = 0;
+    quint32 samples = 0;
+    qint64  paintTime = 0;      //最近一次绘制耗时
+    qreal   cacheHitRate = 0;   //排版缓存命中率
+    int     glyphs = 0;         //最近一次绘制的字符数
+    qreal   shapeHitRate = 0;   //进程级排版缓存（CShapeCache）命中率
+    int     shapeEntries = 0;
+    int     shapeKilobytes = 0;
+} SPerfStats;
 
 class CGraphicsEdit : public QGraphicsObject
 {
@@ -72,7 +64,13 @@ public:
     Qt::TextInteractionFlags textInteractionFlags() const;
     QString text() const;
     void setText(const QString& text);
-    void updateData(const QStringList& sl, int cols, int pos, int currCol, const QList<QList<SCharFormat>>& sf);
+    const VerticalTextDocument& document() const { return m_document; }
+    //恢复文档快照（不记录撤销）
+    void updateData(const VerticalTextDocument& doc, int pos, int currCol);
+    //删除指定范围文字（不记录撤销）
+    void removeRange(int startCol, int startPos, int endCol, int endPos);
+    //在指定列位置插入文档，光标移到插入结束处（不记录撤销）
+    void insertDocument(int col, int pos, const VerticalTextDocument& doc);
     int alignment() const { return m_alignment; }
     void setAlignment(TextAlignment d);
     QString toHtml() const;
@@ -85,6 +83,52 @@ public:
     void setColumnSpacing(qreal spacing);
     void setLetterSpacing(qreal spacing);
     void setTextOriection(TextOriection oriection);
+    //开始/结束一次连续的格式修改（如拖动滑块），期间的修改合并为一个撤销步骤（包括列间距）
+    void beginFormatChange();
+    void endFormatChange();
+    //批量插入文本，position为text()中的偏移（列间换行计1，-1为光标处），整体只记录一次撤销
+    //formatId为CFormatRegistry中的ID，-1或未登记的ID使用当前输入格式（下同）
+    void insertText(int position, QStringView text, int formatId = -1);
+    void insertRuns(int position, const QVector<STextRun>& runs);
+    //追加到文档末尾（不记录撤销），用于持续输入的数据源
+    void appendText(QStringView text, int formatId = -1);
+    //列数上限，0为不限；超出时从开头移出旧列
+    //撤销命令执行时按之后移出的列数换算列号，涉及移出列的命令不能撤销（也不能再撤销到更早的状态）
+    void setMaximumColumnCount(int count);
+    int maximumColumnCount() const { return m_maxColumns; }
+    //任意线程调用：放入无锁队列，GUI线程每帧取出一次，整批追加（只失效一次、重绘一次）
+    void postAppend(const QString& text, int formatId = -1);
+    //移动光标到text()偏移处，并清除选中
+    void setCursorPosition(int position);
+    //分块渲染：文字在工作线程中按图块绘制并缓存，适合字号很大或列很多的文档
+    void setTiledRendering(bool enabled);
+    bool tiledRendering() const { return m_tileRenderer != nullptr; }
+    //虚拟显示：只度量视口附近的列，适合在滚动视图中浏览很大的文档
+    //映射文件总是虚拟显示，换成可编辑的文档后恢复打开前的状态
+    void setVirtualized(bool enabled);
+    bool isVirtualized() const { return m_layout.isVirtualized(); }
+    //只读浏览大文本文件：文件映射到内存，后台建立列索引，只解码可见列，全部使用默认格式
+    bool openMappedFile(const QString& fileName, QString* error = nullptr);
+    bool isReadOnly() const { return m_document.isMapped(); }
+    //流式导入纯文本：清空文档后在后台分块解码device（本项接管），每块到达时追加到末尾
+    //第一块到达后即可显示和编辑；导入结束时清空撤销栈（导入期间的快照不含之后到达的文字）
+    void importPlainText(QIODevice* device, const QByteArray& codecName = QByteArray());
+    bool isImporting() const;
+    //查找：全部匹配高亮显示，文档修改后只重新查找改动的列
+    void setSearchPattern(const QString& pattern, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+    QString searchPattern() const { return m_search.pattern(); }
+    int matchCount() const;
+    //从光标处查找下一个/上一个匹配并选中，到末尾后从头继续
+    bool findNext();
+    bool findPrevious();
+    //选中的是匹配时替换（一个撤销步骤），然后选中下一个匹配；返回是否替换
+    bool replaceNext(const QString& after);
+    //选中范围并滚动到可见处，超出文档的部分被截掉
+    void selectRange(const STextRange& r);
+    //全部替换，作为一个撤销步骤，只重新排版一次；返回替换的个数，after不能含换行
+    int replaceAll(const QString& after);
+    SPerfStats perfStats() const;
+    void resetPerfStats();
 protected:
     virtual QRectF boundingRect() const override;
     virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
@@ -97,11 +141,20 @@ protected:
     virtual void mouseMoveEvent(QGraphicsSceneMouseEvent *event) override;
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
     virtual void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
+signals:
+    void importFinished(bool ok, const QString& error);
+    void virtualizedChanged(bool enabled);
 public slots:
     void onTimeout();
     void onFontChanged(const QString& text);
     void onColorSelected(const QColor &color);
+    //映射文件索引有进展时更新几何
+    void onLinesIndexed(int count);
+    //取出postAppend排队的文字
+    void drainAppends();
 private:
+    //撤销命令按累计的移出列数换算列号，撤销时记下当前光标和列间距
+    friend class CEditCommand;
     void processEvent(QEvent* event);
     bool isAcceptableInput(QKeyEvent* e);
     bool isCommonTextEditShortcut(QKeyEvent* e);
@@ -111,33 +164,52 @@ private:
     void redo();
     void cut();
     void paste(QClipboard::Mode);
-    //获取列宽
-    qreal getColWidth(int index) const;
-    qreal getColXPostion(int index) const;
-    //获取行高
-    qreal getRowHeight(int index) const;
-    qreal getRowYPostion(int index) const;
-    //获取选中文本
-    QString getSelectedText() const;
+    //对选中文字或当前输入格式应用修改
+    template<typename Fn> void applyFormat(Fn fn);
+    //text()偏移转换为列号和列内位置
+    void positionToColumn(int position, int* col, int* pos) const;
+    void insertPlainText(const QString& text);
+    //文档修改后使对应列的排版失效并重绘
+    void documentChanged(int first, int removed, int inserted);
+    STextRange selectedRange() const;
     //删除选中文字
     void deleteSelectText();
     //更新选中文本
     void updateSelectedText(int beginCol, int endCol, int beginPos, int endPos);
-    //获取字符串竖排高度
-    qreal getStrHeight(int index) const;
-    //获取字符串横排宽度
-    qreal getStrWidth(int index) const;
-    //垂直绘制
-    void verticalPaint(QPainter* painter, const QRectF& r);
-    //水平绘制
-    void horizontalPaint(QPainter* painter, const QRectF& r);
+    //光标沿列方向后退/前进一个字形簇（word时为一个单词），到列首/列尾时进入相邻列
+    void moveBackward(bool word);
+    void moveForward(bool word);
+    //光标移到相邻列，列内位置保持不变（超出时到列尾）
+    void moveToColumn(int col);
+    //文档修改后更新查找结果，参数同documentChanged
+    void updateMatches(int first, int removed, int inserted);
+    void ensureMatches() const;
+    void drawMatches(QPainter* painter, const QRectF& exposed) const;
+    //选中匹配并滚动到可见处，backward时光标放在开头
+    void selectMatch(const STextRange& r, bool backward);
+    //半透明绘制选中区域（文字不单独变色时使用）
+    void drawSelectionOverlay(QPainter* painter) const;
+    //缩小显示时绘制低分辨率缓存图，图太大时返回false
+    bool drawLodPixmap(QPainter* painter, qreal scale);
+    //切换虚拟显示并通知界面
+    void setLayoutVirtualized(bool enabled);
+    //文档从映射文件换成可编辑的文档时恢复打开前的虚拟显示状态
+    void leaveMappedFile(bool wasMapped);
+    //超过列数上限时移出开头的列，光标和选中范围随之移动
+    void evictColumns();
+    //调用方传入的格式ID：-1和未登记的ID换成当前输入格式
+    int validFormatId(int formatId) const;
+    //压入撤销栈
+    void pushUndo(QUndoCommand* command);
+    //已处理的输入事件从start开始计时，下一次绘制完成时计入延迟
+    void markInput(qint64 start);
 private:
-    QStringList    m_textList;
+    VerticalTextDocument m_document;
+    VerticalTextLayout   m_layout;
+    CBoundaryIndex       m_boundaries;
     QTimer         *m_timer;
     bool           m_showCursor;
     int            m_postion;   //光标位置
-    QMutex         m_mutex;
-    int            m_cols;          //列数
     int            m_currColumn;    //当前列标号
     Qt::TextInteractionFlags interactionFlags;
     bool           m_repaint = false;
@@ -149,10 +221,35 @@ private:
     TextAlignment  m_alignment;
     TextOriection  m_oriection;
     SCharFormat    m_textFormat;
-    //兼容html
-    QGraphicsTextItem*   m_textItem;
-    QList<QList<SCharFormat>>   m_charFormats;
-    qreal         m_columnSpacing = 0;
+    int            m_textFormatId = -1;
+    //连续格式修改
+    bool          m_formatChanging = false;
+    bool          m_formatChanged = false;
+    CTextChanged* m_formatUndo = nullptr;
+    CTileRenderer*    m_tileRenderer = nullptr;
+    //缩小显示的缓存图
+    QPixmap           m_lodPixmap;
+    int               m_lodRevision = -1;
+    qreal             m_lodScale = 0;
+    //性能统计
+    QElapsedTimer     m_clock;
+    qint64            m_inputStart = -1;
+    CLatencyHistogram m_latency;
+    qint64            m_paintTime = 0;
+    int               m_frameGlyphs = 0;
+    int               m_indexedLines = 0;
+    bool              m_virtualizedBeforeMapped = false;
+    CTextImporter*    m_importer = nullptr;
+    int               m_importGeneration = 0;
+    int               m_maxColumns = 0;
+    qint64            m_evictedColumns = 0;   //累计移出的列数
+    //其他线程追加的文字
+    CMpscQueue<STextRun> m_appendQueue;
+    QAtomicInteger<int>  m_drainScheduled;
+    //查找结果，按位置排序
+    CTextSearch                  m_search;
+    mutable QVector<STextRange>  m_matches;
+    mutable bool                 m_matchesValid = false;
 };
 
 #endif // CGRAPHICSEDIT_H
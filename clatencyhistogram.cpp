@@ -0,0 +1,57 @@
+#include "clatencyhistogram.h"
+#include <QtAlgorithms>
+#include <cmath>
+
+CLatencyHistogram::CLatencyHistogram()
+{
+    reset();
+}
+
+int CLatencyHistogram::bucketFor(qint64 usecs)
+{
+    const quint32 us = quint32(qBound<qint64>(1, usecs, 0xFFFFFFFF));
+    const int msb = 31 - int(qCountLeadingZeroBits(us));
+    //最高位所在区间 + 其后两位
+    const int sub = int((quint64(us) << 2) >> msb) & 3;
+    return msb * 4 + sub;
+}
+
+qint64 CLatencyHistogram::upperBound(int index)
+{
+    return ((qint64(5 + index % 4)) << (index / 4)) >> 2;
+}
+
+void CLatencyHistogram::record(qint64 nsecs)
+{
+    m_buckets[bucketFor(nsecs / 1000)].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelease(1);
+}
+
+qint64 CLatencyHistogram::percentile(qreal p) const
+{
+    //先取快照，避免并发写入导致总数不一致
+    quint32 counts[BucketCount];
+    quint64 total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts[i] = m_buckets[i].load();
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+    const quint64 target = qMax<quint64>(1, quint64(std::ceil(qBound<qreal>(0, p, 1) * total)));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += counts[i];
+        if (seen >= target)
+            return upperBound(i);
+    }
+    return upperBound(BucketCount - 1);
+}
+
+void CLatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i].store(0);
+    }
+    m_count.storeRelease(0);
+}
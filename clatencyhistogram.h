@@ -0,0 +1,27 @@
+#ifndef CLATENCYHISTOGRAM_H
+#define CLATENCYHISTOGRAM_H
+
+#include <QAtomicInteger>
+
+//延迟直方图：每2倍区间分4档（1us起，约19%精度），记录和读取均无锁，可跨线程使用
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+
+    void record(qint64 nsecs);
+    //百分位数（0~1），返回所在档的上界，单位微秒；无样本时为0
+    qint64 percentile(qreal p) const;
+    quint32 count() const { return m_count.loadAcquire(); }
+    void reset();
+
+    static const int BucketCount = 128;
+private:
+    static int bucketFor(qint64 usecs);
+    static qint64 upperBound(int index);
+private:
+    QAtomicInteger<quint32> m_buckets[BucketCount];
+    QAtomicInteger<quint32> m_count;
+};
+
+#endif // CLATENCYHISTOGRAM_H
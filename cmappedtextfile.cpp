@@ -0,0 +1,170 @@
+#include "cmappedtextfile.h"
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <cstring>
+#include "ctrace.h"
+
+//索引线程每次映射的窗口大小，扫描过的窗口随即解除映射
+static const qint64 INDEX_WINDOW = 32 * 1024 * 1024;
+//索引进度通知间隔（毫秒）
+static const int INDEX_NOTIFY_MSECS = 100;
+//缓存的解码结果列数
+static const int DECODED_LINES = 1024;
+
+CMappedTextFile::CMappedTextFile(QObject* parent):
+    QObject(parent)
+{
+    m_lines.setMaxCost(DECODED_LINES);
+}
+
+CMappedTextFile::~CMappedTextFile()
+{
+    m_stop.store(1);
+    m_future.waitForFinished();
+}
+
+bool CMappedTextFile::open(const QString& fileName, QString* error)
+{
+    Q_ASSERT(!m_file.isOpen());
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (error) *error = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    if (m_size > 0) {
+        //只建立映射，页面在访问时才读入
+        m_data = m_file.map(0, m_size);
+        if (!m_data) {
+            if (error) *error = m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+    m_indexing.store(1);
+    m_future = QtConcurrent::run([this]() { buildIndex(); });
+    return true;
+}
+
+qint64 CMappedTextFile::scanColumn(const uchar* p, qint64 available, qint64* consumed, bool* last)
+{
+    if (available <= 0) {
+        *consumed = 0;
+        *last = true;
+        return 0;
+    }
+    //多找一个字节，正好MaxColumnBytes长的行不会被拆开
+    const qint64 n = qMin<qint64>(available, MaxColumnBytes + 1);
+    const uchar* nl = static_cast<const uchar*>(std::memchr(p, '\n', size_t(n)));
+    if (nl) {
+        qint64 length = nl - p;
+        *consumed = length + 1;
+        *last = false;
+        if (length > 0 && p[length - 1] == '\r')
+            --length;
+        return length;
+    }
+    if (available > MaxColumnBytes) {
+        //在UTF-8字符边界处拆开
+        qint64 length = MaxColumnBytes;
+        while (length > 0 && (p[length] & 0xC0) == 0x80) {
+            --length;
+        }
+        if (length == 0)
+            length = MaxColumnBytes;
+        *consumed = length;
+        *last = false;
+        return length;
+    }
+    *consumed = available;
+    *last = true;
+    return available;
+}
+
+void CMappedTextFile::buildIndex()
+{
+    TRACE_SCOPE(lcTraceImport, "CMappedTextFile::buildIndex");
+    //单独打开一次，按窗口映射，不影响主映射的常驻内存
+    QFile file(m_file.fileName());
+    const bool opened = file.open(QIODevice::ReadOnly);
+    uchar* map = nullptr;
+    qint64 mapBegin = 0;
+    qint64 mapEnd = 0;
+    qint64 pos = 0;
+    int count = 0;
+    int maxLength = 0;
+    QElapsedTimer timer;
+    timer.start();
+    while (opened && !m_stop.load()) {
+        //窗口内至少要有一整列和换行符
+        if (m_size > 0 && (!map || (pos + MaxColumnBytes + 1 > mapEnd && mapEnd < m_size))) {
+            if (map)
+                file.unmap(map);
+            mapBegin = pos;
+            mapEnd = qMin(m_size, pos + INDEX_WINDOW);
+            map = file.map(mapBegin, mapEnd - mapBegin);
+            if (!map)
+                break;
+        }
+        if (count % IndexStride == 0) {
+            QWriteLocker locker(&m_indexLock);
+            m_stride << pos;
+        }
+        const uchar* p = (map ? map + (pos - mapBegin) : nullptr);
+        qint64 consumed = 0;
+        bool last = false;
+        const qint64 length = scanColumn(p, m_size - pos, &consumed, &last);
+        //UTF-16长度：每个首字节一个单元，四字节序列是代理对
+        int units = 0;
+        for (qint64 k = 0; k < length; ++k) {
+            const uchar b = p[k];
+            units += int((b & 0xC0) != 0x80) + int(b >= 0xF0);
+        }
+        maxLength = qMax(maxLength, units);
+        ++count;
+        pos += consumed;
+        if (last)
+            break;
+        if (timer.elapsed() >= INDEX_NOTIFY_MSECS) {
+            m_maxLength.store(maxLength);
+            m_lineCount.store(count);
+            emit linesIndexed(count);
+            timer.restart();
+        }
+    }
+    if (map)
+        file.unmap(map);
+    m_maxLength.store(maxLength);
+    m_lineCount.store(count);
+    m_indexing.store(0);
+    emit linesIndexed(count);
+    emit indexFinished();
+}
+
+QString CMappedTextFile::line(int index) const
+{
+    if (index < 0 || index >= m_lineCount.load() || !m_data)
+        return QString();
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        if (const QString* s = m_lines.object(index))
+            return *s;
+    }
+    qint64 pos;
+    {
+        QReadLocker locker(&m_indexLock);
+        pos = m_stride.at(index / IndexStride);
+    }
+    //从最近的索引点向后数
+    qint64 consumed = 0;
+    bool last = false;
+    qint64 length = scanColumn(m_data + pos, m_size - pos, &consumed, &last);
+    for (int k = index % IndexStride; k > 0; --k) {
+        pos += consumed;
+        length = scanColumn(m_data + pos, m_size - pos, &consumed, &last);
+    }
+    const QString s = QString::fromUtf8(reinterpret_cast<const char*>(m_data + pos), int(length));
+    QMutexLocker locker(&m_cacheMutex);
+    m_lines.insert(index, new QString(s));
+    return s;
+}
@@ -0,0 +1,59 @@
+#ifndef CMAPPEDTEXTFILE_H
+#define CMAPPEDTEXTFILE_H
+
+#include <QObject>
+#include <QFile>
+#include <QVector>
+#include <QCache>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+#include <QFuture>
+
+//只读映射的UTF-8文本文件：后台线程扫描一遍建立列索引，列文字在用到时才解码
+//每IndexStride列记录一个起点，内存占用与文件大小无关；超长的行按MaxColumnBytes拆成多列
+class CMappedTextFile : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CMappedTextFile(QObject* parent = nullptr);
+    ~CMappedTextFile();
+
+    //映射文件并开始建立索引，立即返回
+    bool open(const QString& fileName, QString* error = nullptr);
+    QString fileName() const { return m_file.fileName(); }
+    qint64 size() const { return m_size; }
+
+    //已建立索引的列数，至少为1
+    int lineCount() const { return qMax(1, int(m_lineCount.load())); }
+    //已索引列中最长的一列（UTF-16字符数）
+    int maxLineLength() const { return m_maxLength.load(); }
+    bool isIndexing() const { return m_indexing.load() != 0; }
+    QString line(int index) const;
+
+    static const int MaxColumnBytes = 4096;
+    static const int IndexStride = 64;
+signals:
+    //在索引线程中发出
+    void linesIndexed(int count);
+    void indexFinished();
+private:
+    //从p开始的一列：返回内容字节数（不含换行），*consumed为到下一列起点的字节数，*last表示是最后一列
+    static qint64 scanColumn(const uchar* p, qint64 available, qint64* consumed, bool* last);
+    void buildIndex();
+private:
+    QFile                         m_file;
+    const uchar*                  m_data = nullptr;
+    qint64                        m_size = 0;
+    mutable QReadWriteLock        m_indexLock;
+    QVector<qint64>               m_stride;          //第k*IndexStride列的起点
+    QAtomicInteger<int>           m_lineCount;
+    QAtomicInteger<int>           m_maxLength;
+    QAtomicInteger<int>           m_indexing;
+    QAtomicInteger<int>           m_stop;
+    QFuture<void>                 m_future;
+    mutable QMutex                m_cacheMutex;
+    mutable QCache<int, QString>  m_lines;           //最近解码的列
+};
+
+#endif // CMAPPEDTEXTFILE_H
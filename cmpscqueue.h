@@ -0,0 +1,49 @@
+#ifndef CMPSCQUEUE_H
+#define CMPSCQUEUE_H
+
+#include <QAtomicPointer>
+#include <utility>
+
+//无锁多生产者单消费者队列（Vyukov算法）：push可在任意线程调用，tryPop只能在一个线程调用
+//push只有一次原子交换，不会阻塞；生产者写到一半时tryPop可能暂时返回false，之后会取到
+template<typename T>
+class CMpscQueue
+{
+public:
+    CMpscQueue() : m_tail(new Node) { m_head.store(m_tail); }
+    ~CMpscQueue() {
+        T value;
+        while (tryPop(&value)) {
+        }
+        delete m_tail;
+    }
+
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* prev = m_head.fetchAndStoreOrdered(node);
+        prev->next.storeRelease(node);
+    }
+    bool tryPop(T* value) {
+        Node* tail = m_tail;
+        Node* next = tail->next.loadAcquire();
+        if (!next)
+            return false;
+        //next成为新的空头结点
+        *value = std::move(next->value);
+        m_tail = next;
+        delete tail;
+        return true;
+    }
+private:
+    typedef struct Node{
+        QAtomicPointer<Node> next;
+        T                    value;
+    } Node;
+
+    Q_DISABLE_COPY(CMpscQueue)
+    QAtomicPointer<Node>  m_head;     //最后入队的结点，生产者共用
+    Node*                 m_tail;     //空头结点，只有消费者访问
+};
+
+#endif // CMPSCQUEUE_H
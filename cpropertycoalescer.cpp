@@ -0,0 +1,90 @@
+#include "cpropertycoalescer.h"
+#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
+
+static const int DEFAULT_IDLE_TIMEOUT = 400;
+
+CPropertyCoalescer::CPropertyCoalescer(QObject* parent):
+    QObject(parent),
+    m_frameTimer(new QTimer(this)),
+    m_idleTimer(new QTimer(this))
+{
+    //按主屏刷新率节流预览
+    qreal rate = 60;
+    if (QScreen* screen = QGuiApplication::primaryScreen()) {
+        if (screen->refreshRate() > 1)
+            rate = screen->refreshRate();
+    }
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    m_frameTimer->setSingleShot(true);
+    m_frameTimer->setInterval(qMax(1, qRound(1000.0 / rate)));
+    connect(m_frameTimer, &QTimer::timeout, this, &CPropertyCoalescer::onFrame);
+
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(DEFAULT_IDLE_TIMEOUT);
+    connect(m_idleTimer, &QTimer::timeout, this, &CPropertyCoalescer::onIdle);
+}
+
+void CPropertyCoalescer::setValue(const QVariant& value)
+{
+    if (!m_active) {
+        m_active = true;
+        emit started();
+    }
+    m_pending = value;
+    m_dirty = true;
+    //不在节流周期内则立即预览
+    if (!m_frameTimer->isActive()) {
+        onFrame();
+    }
+    if (!m_held) {
+        m_idleTimer->start();
+    }
+}
+
+void CPropertyCoalescer::setIdleTimeout(int msec)
+{
+    m_idleTimer->setInterval(msec);
+}
+
+void CPropertyCoalescer::hold()
+{
+    m_held = true;
+    m_idleTimer->stop();
+}
+
+void CPropertyCoalescer::release()
+{
+    m_held = false;
+    finish();
+}
+
+void CPropertyCoalescer::onFrame()
+{
+    if (!m_dirty)
+        return;
+    m_dirty = false;
+    emit preview(m_pending);
+    m_frameTimer->start();
+}
+
+void CPropertyCoalescer::onIdle()
+{
+    if (!m_held)
+        finish();
+}
+
+void CPropertyCoalescer::finish()
+{
+    m_frameTimer->stop();
+    m_idleTimer->stop();
+    if (m_dirty) {
+        m_dirty = false;
+        emit preview(m_pending);
+    }
+    if (m_active) {
+        m_active = false;
+        emit committed();
+    }
+}
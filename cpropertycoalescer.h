@@ -0,0 +1,44 @@
+#ifndef CPROPERTYCOALESCER_H
+#define CPROPERTYCOALESCER_H
+
+#include <QObject>
+#include <QVariant>
+
+class QTimer;
+
+//合并控件连续产生的属性值：按屏幕刷新率预览最新值，交互结束时提交一次
+class CPropertyCoalescer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CPropertyCoalescer(QObject* parent = nullptr);
+
+    //设置新值，首个值立即预览，之后每帧最多预览一次
+    void setValue(const QVariant& value);
+    //空闲多久后自动提交（未按住时）
+    void setIdleTimeout(int msec);
+    bool isActive() const { return m_active; }
+public slots:
+    //交互开始（如滑块按下），期间不会自动提交
+    void hold();
+    //交互结束，应用最新值并提交
+    void release();
+signals:
+    void started();
+    void preview(const QVariant& value);
+    void committed();
+private slots:
+    void onFrame();
+    void onIdle();
+private:
+    void finish();
+private:
+    QTimer*   m_frameTimer;
+    QTimer*   m_idleTimer;
+    QVariant  m_pending;
+    bool      m_dirty = false;
+    bool      m_active = false;
+    bool      m_held = false;
+};
+
+#endif // CPROPERTYCOALESCER_H
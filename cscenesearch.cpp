@@ -0,0 +1,107 @@
+#include "cscenesearch.h"
+#include <QGraphicsScene>
+#include <QGraphicsItem>
+#include <QThread>
+#include <QtConcurrent>
+#include "cgraphicsedit.h"
+#include "ctrace.h"
+
+CSceneSearch::CSceneSearch(QObject* parent):
+    QObject(parent)
+{
+    //留一个核心给界面线程
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+CSceneSearch::~CSceneSearch()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void CSceneSearch::cancel()
+{
+    if (m_cancel)
+        m_cancel->store(1);
+    m_pool.clear();
+    ++m_generation;
+    m_remaining = 0;
+}
+
+void CSceneSearch::start(QGraphicsScene* scene, const QString& pattern, Qt::CaseSensitivity cs)
+{
+    TRACE_SCOPE(lcTraceSearch, "CSceneSearch::start");
+    cancel();
+    m_hits.clear();
+    const CTextSearch search(pattern, cs);
+    if (!scene || !search.isValid()) {
+        emit finished(0);
+        return;
+    }
+    const int generation = m_generation;
+    const QSharedPointer<QAtomicInteger<int>> cancelled(new QAtomicInteger<int>(0));
+    m_cancel = cancelled;
+    const QList<QGraphicsItem*> items = scene->items(Qt::AscendingOrder);
+    for (QGraphicsItem* gi : items) {
+        CGraphicsEdit* edit = qobject_cast<CGraphicsEdit*>(gi->toGraphicsObject());
+        if (!edit)
+            continue;
+        //文档快照是O(1)的，item之后被修改或删除都不影响任务
+        const VerticalTextDocument doc = edit->document();
+        const QPointer<CGraphicsEdit> item(edit);
+        ++m_remaining;
+        QtConcurrent::run(&m_pool, [this, generation, cancelled, item, doc, search]() {
+            TRACE_SCOPE(lcTraceSearch, "CSceneSearch::searchItem");
+            auto post = [&](const QVector<STextRange>& ranges, bool last) {
+                QMetaObject::invokeMethod(this, [this, generation, item, ranges, last]() {
+                    onBatch(generation, item, ranges, last);
+                }, Qt::QueuedConnection);
+            };
+            QVector<STextRange> batch;
+            const int n = doc.columnCount();
+            for (int col = 0; col < n; ++col) {
+                if (cancelled->load())
+                    return;
+                search.findInColumn(doc, col, &batch);
+                if (batch.size() >= BatchHits) {
+                    post(batch, false);
+                    batch.clear();
+                }
+            }
+            post(batch, true);
+        });
+    }
+    if (m_remaining == 0)
+        emit finished(0);
+}
+
+void CSceneSearch::onBatch(int generation, const QPointer<CGraphicsEdit>& item, const QVector<STextRange>& ranges, bool last)
+{
+    //上一次查找的结果
+    if (generation != m_generation)
+        return;
+    const int first = m_hits.size();
+    if (item) {
+        m_hits.reserve(first + ranges.size());
+        for (const STextRange& r : ranges) {
+            m_hits << SHit{item, r};
+        }
+    }
+    if (m_hits.size() > first)
+        emit hitsFound(first, m_hits.size() - first);
+    if (last && --m_remaining == 0)
+        emit finished(m_hits.size());
+}
+
+bool CSceneSearch::select(int index)
+{
+    if (index < 0 || index >= m_hits.size())
+        return false;
+    const SHit& hit = m_hits.at(index);
+    CGraphicsEdit* edit = hit.item.data();
+    if (!edit)
+        return false;
+    edit->setFocus();
+    edit->selectRange(hit.range);
+    return true;
+}
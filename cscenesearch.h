@@ -0,0 +1,56 @@
+#ifndef CSCENESEARCH_H
+#define CSCENESEARCH_H
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+#include <QSharedPointer>
+#include <QAtomicInteger>
+#include <QThreadPool>
+#include "ctextsearch.h"
+
+class QGraphicsScene;
+class CGraphicsEdit;
+
+//场景查找：取场景中每个CGraphicsEdit的文档快照，在线程池中并发查找，命中分批送回界面线程
+//查找期间可以继续编辑；命中是快照中的位置，之后修改过的item选中时限制在文档范围内
+class CSceneSearch : public QObject
+{
+    Q_OBJECT
+public:
+    typedef struct SHit{
+        QPointer<CGraphicsEdit> item;
+        STextRange              range;
+    } SHit;
+
+    explicit CSceneSearch(QObject* parent = nullptr);
+    //取消并等待工作线程结束
+    ~CSceneSearch();
+
+    //取消上一次查找并开始新的查找，立即返回
+    void start(QGraphicsScene* scene, const QString& pattern, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+    //不等待，正在查找的任务在下一列处停止
+    void cancel();
+    bool isRunning() const { return m_remaining > 0; }
+    //已收到的命中：同一item内按位置排序，item之间按完成先后
+    const QVector<SHit>& hits() const { return m_hits; }
+    //选中命中的文字，item获得焦点并滚动到可见处；item已删除时返回false
+    bool select(int index);
+
+    //一批最多的命中数
+    static const int BatchHits = 4096;
+signals:
+    //hits()中新增了从first开始的count个命中
+    void hitsFound(int first, int count);
+    void finished(int total);
+private:
+    void onBatch(int generation, const QPointer<CGraphicsEdit>& item, const QVector<STextRange>& ranges, bool last);
+private:
+    QThreadPool                             m_pool;
+    QSharedPointer<QAtomicInteger<int>>     m_cancel;      //每次查找一个，旧任务看到的是自己的标记
+    int                                     m_generation = 0;
+    int                                     m_remaining = 0;   //尚未完成的item数
+    QVector<SHit>                           m_hits;
+};
+
+#endif // CSCENESEARCH_H
@@ -0,0 +1,94 @@
+#include "cselectionmimedata.h"
+#include "ctrace.h"
+
+static const QString MIME_TEXT = QStringLiteral("text/plain");
+static const QString MIME_HTML = QStringLiteral("text/html");
+
+static QString spanStyle(const SCharFormat& f)
+{
+    QString style;
+    style += QStringLiteral("font-family:'%1';").arg(QString(f.fontText).replace(QChar('\''), QStringLiteral("&#39;")));
+    style += QStringLiteral(" font-size:%1pt;").arg(f.fontSize);
+    style += QStringLiteral(" font-weight:%1;").arg(f.bold ? 600 : 400);
+    style += (f.italic ? QStringLiteral(" font-style:italic;") : QStringLiteral(" font-style:normal;"));
+    if (f.underline || f.overline || f.strikeOut) {
+        style += QStringLiteral(" text-decoration:");
+        if (f.underline) style += QStringLiteral(" underline");
+        if (f.overline) style += QStringLiteral(" overline");
+        if (f.strikeOut) style += QStringLiteral(" line-through");
+        style += QChar(';');
+    }
+    style += QStringLiteral(" color:%1;").arg(f.fontColor.name());
+    if (f.letterSpacing != 0) {
+        style += QStringLiteral(" letter-spacing:%1px;").arg(f.letterSpacing);
+    }
+    return style;
+}
+
+CSelectionMimeData::CSelectionMimeData(const VerticalTextDocument& doc, const STextRange& range):
+    m_document(doc),
+    m_range(range)
+{
+
+}
+
+QStringList CSelectionMimeData::formats() const
+{
+    return QStringList() << MIME_HTML << MIME_TEXT;
+}
+
+bool CSelectionMimeData::hasFormat(const QString& mimeType) const
+{
+    return mimeType == MIME_TEXT || mimeType == MIME_HTML;
+}
+
+QVariant CSelectionMimeData::retrieveData(const QString& mimeType, QVariant::Type preferredType) const
+{
+    Q_UNUSED(preferredType);
+    TRACE_SCOPE(lcTraceExport, "CSelectionMimeData::retrieveData");
+    //首次请求时才生成
+    if (mimeType == MIME_TEXT) {
+        if (m_plainText.isNull())
+            m_plainText = m_document.toPlainText(m_range);
+        return m_plainText;
+    } else if (mimeType == MIME_HTML) {
+        if (m_html.isNull())
+            m_html = html(m_document, m_range);
+        return m_html;
+    }
+    return QMimeData::retrieveData(mimeType, preferredType);
+}
+
+QString CSelectionMimeData::html(const VerticalTextDocument& doc, const STextRange& range)
+{
+    QString s = QStringLiteral("<html><body>");
+    //每种格式只生成一次样式
+    QHash<int, QString> styles;
+    for (int i = range.startCol; i <= range.endCol; ++i) {
+        const QString str = doc.text(i);
+        const QVector<int> sf = doc.formats(i);
+        const int bp = (i == range.startCol ? range.startPos : 0);
+        const int ep = qMin(i == range.endCol ? range.endPos : str.length(), str.length());
+        //映射文件的文档没有逐字格式
+        auto formatAt = [&](int k) { return k < sf.size() ? sf.at(k) : doc.formatAt(i, k); };
+        s += QStringLiteral("<p style=\"margin:0px;\">");
+        int j = bp;
+        while (j < ep) {
+            const int id = formatAt(j);
+            int k = j + 1;
+            while (k < ep && formatAt(k) == id) {
+                ++k;
+            }
+            QHash<int, QString>::const_iterator it = styles.constFind(id);
+            if (it == styles.constEnd())
+                it = styles.insert(id, spanStyle(CFormatRegistry::format(id)));
+            s += QStringLiteral("<span style=\"%1\">").arg(it.value());
+            s += str.mid(j, k - j).toHtmlEscaped();
+            s += QStringLiteral("</span>");
+            j = k;
+        }
+        s += QStringLiteral("</p>");
+    }
+    s += QStringLiteral("</body></html>");
+    return s;
+}
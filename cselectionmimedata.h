@@ -0,0 +1,28 @@
+#ifndef CSELECTIONMIMEDATA_H
+#define CSELECTIONMIMEDATA_H
+
+#include <QMimeData>
+#include "verticaltextdocument.h"
+
+//复制选中文本时使用：保存选区快照，其他程序请求时才生成text/plain和text/html
+class CSelectionMimeData : public QMimeData
+{
+    Q_OBJECT
+public:
+    CSelectionMimeData(const VerticalTextDocument& doc, const STextRange& range);
+
+    QStringList formats() const override;
+    bool hasFormat(const QString& mimeType) const override;
+
+    //选区html，相同格式ID的连续文字合并为一个span
+    static QString html(const VerticalTextDocument& doc, const STextRange& range);
+protected:
+    QVariant retrieveData(const QString& mimeType, QVariant::Type preferredType) const override;
+private:
+    VerticalTextDocument        m_document;     //文档快照（隐式共享）
+    STextRange                  m_range;
+    mutable QString             m_plainText;
+    mutable QString             m_html;
+};
+
+#endif // CSELECTIONMIMEDATA_H
@@ -0,0 +1,130 @@
+#include "cshapecache.h"
+#include <QMutex>
+#include <QCache>
+#include <QHash>
+
+static const int DEFAULT_CACHE_LIMIT = 32 * 1024;     //KB
+
+namespace {
+struct ShapeEntry {
+    CShapeCache::ColumnPointer               column;
+    QVector<CShapeCache::SShapedRun>         runs;
+    bool                                     shaped = false;
+};
+
+struct ShapeTable {
+    QMutex                          lock;
+    QCache<quint64, ShapeEntry>     entries;
+    quint64                         hits = 0;
+    quint64                         misses = 0;
+
+    ShapeTable() { entries.setMaxCost(DEFAULT_CACHE_LIMIT); }
+};
+
+ShapeTable& shapeTable()
+{
+    static ShapeTable table;
+    return table;
+}
+
+//按内容估算的占用（KB）
+int entryCost(const CShapeCache::SShapedColumn& c, const QVector<CShapeCache::SShapedRun>& runs)
+{
+    qint64 bytes = c.text.size() * qint64(sizeof(QChar)) + c.formats.size() * qint64(sizeof(int))
+                 + c.offsets.size() * qint64(sizeof(qreal)) + (c.runs.size() + c.sideways.size()) * qint64(sizeof(int));
+    for (const CShapeCache::SShapedRun& r : runs) {
+        bytes += r.glyphs.size() * qint64(sizeof(quint32)) + r.positions.size() * qint64(sizeof(QPointF));
+    }
+    return int(bytes / 1024) + 1;
+}
+}
+
+quint64 CShapeCache::key(const QString& text, const QVector<int>& formats, bool vertical)
+{
+    const uint h1 = qHash(text, vertical ? 1 : 0);
+    const uint h2 = qHashBits(formats.constData(), size_t(formats.size()) * sizeof(int), uint(text.size()));
+    return (quint64(h1) << 32) | h2;
+}
+
+CShapeCache::ColumnPointer CShapeCache::find(quint64 key, const QString& text, const QVector<int>& formats, bool vertical)
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    const ShapeEntry* e = t.entries.object(key);
+    if (!e || e->column->vertical != vertical || e->column->text != text || e->column->formats != formats) {
+        ++t.misses;
+        return ColumnPointer();
+    }
+    ++t.hits;
+    return e->column;
+}
+
+void CShapeCache::insert(quint64 key, const ColumnPointer& column)
+{
+    ShapeTable& t = shapeTable();
+    ShapeEntry* e = new ShapeEntry;
+    e->column = column;
+    const int cost = entryCost(*column, e->runs);
+    QMutexLocker locker(&t.lock);
+    t.entries.insert(key, e, cost);
+}
+
+bool CShapeCache::findRuns(quint64 key, const SShapedColumn* column, QVector<SShapedRun>* runs)
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    const ShapeEntry* e = t.entries.object(key);
+    if (!e || e->column.data() != column || !e->shaped)
+        return false;
+    *runs = e->runs;
+    return true;
+}
+
+void CShapeCache::insertRuns(quint64 key, const SShapedColumn* column, const QVector<SShapedRun>& runs)
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    ShapeEntry* e = t.entries.take(key);
+    if (!e)
+        return;
+    if (e->column.data() == column) {
+        e->runs = runs;
+        e->shaped = true;
+    }
+    //重新插入以更新占用
+    t.entries.insert(key, e, entryCost(*e->column, e->runs));
+}
+
+CShapeCache::SStats CShapeCache::stats()
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    SStats s;
+    s.hits = t.hits;
+    s.misses = t.misses;
+    s.entries = t.entries.count();
+    s.kilobytes = t.entries.totalCost();
+    return s;
+}
+
+void CShapeCache::resetStats()
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    t.hits = 0;
+    t.misses = 0;
+}
+
+void CShapeCache::setCacheLimit(int kilobytes)
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    t.entries.setMaxCost(kilobytes);
+}
+
+void CShapeCache::clear()
+{
+    ShapeTable& t = shapeTable();
+    QMutexLocker locker(&t.lock);
+    t.entries.clear();
+}
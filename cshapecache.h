@@ -0,0 +1,58 @@
+#ifndef CSHAPECACHE_H
+#define CSHAPECACHE_H
+
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QSharedPointer>
+
+//列排版结果缓存：按(文字, 各字符格式ID, 方向)保存度量和字形序号，进程内所有item共用（线程安全）
+//看板上重复的标签只排版一次，文档重新加载后仍能命中；格式ID在进程内不变，不必比较字体
+class CShapeCache
+{
+public:
+    //同一格式、同一方向的一段字符，glyphs为空时逐字绘制
+    typedef struct SShapedRun{
+        int               begin = 0;
+        int               end = 0;
+        int               formatId = -1;
+        QVector<quint32>  glyphs;
+        QVector<QPointF>  positions;    //列宽为0时的位置：竖排x加半个列宽、横排y加列宽
+    } SShapedRun;
+
+    //一列的度量结果，含义同VerticalTextLayout的列度量
+    typedef struct SShapedColumn{
+        QString         text;
+        QVector<int>    formats;
+        bool            vertical = true;
+        qreal           thickness = 0;
+        qreal           extent = 0;
+        QVector<qreal>  offsets;
+        QVector<int>    runs;
+        QVector<int>    sideways;
+    } SShapedColumn;
+    typedef QSharedPointer<const SShapedColumn> ColumnPointer;
+
+    typedef struct SStats{
+        quint64 hits = 0;
+        quint64 misses = 0;
+        int     entries = 0;
+        int     kilobytes = 0;
+    } SStats;
+
+    static quint64 key(const QString& text, const QVector<int>& formats, bool vertical);
+    //哈希相同时再比较内容，没有时返回空
+    static ColumnPointer find(quint64 key, const QString& text, const QVector<int>& formats, bool vertical);
+    static void insert(quint64 key, const ColumnPointer& column);
+    //字形序号在第一次绘制时生成，column必须是find/insert得到的同一对象
+    static bool findRuns(quint64 key, const SShapedColumn* column, QVector<SShapedRun>* runs);
+    static void insertRuns(quint64 key, const SShapedColumn* column, const QVector<SShapedRun>& runs);
+
+    static SStats stats();
+    static void resetStats();
+    //缓存上限（KB），超出时淘汰最久未用的列
+    static void setCacheLimit(int kilobytes);
+    static void clear();
+};
+
+#endif // CSHAPECACHE_H
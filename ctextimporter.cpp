@@ -0,0 +1,95 @@
+#include "ctextimporter.h"
+#include <QIODevice>
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <QScopedPointer>
+#include "ctrace.h"
+
+//顺序设备等待数据的超时（毫秒）
+static const int READ_TIMEOUT_MSECS = 30000;
+
+CTextImporter::CTextImporter(QObject* parent):
+    QObject(parent)
+{
+    m_thread.setObjectName(QStringLiteral("CTextImporter"));
+}
+
+CTextImporter::~CTextImporter()
+{
+    cancel();
+    m_thread.quit();
+    m_thread.wait();
+    //排队的run()还没执行线程就已退出
+    delete m_device.fetchAndStoreOrdered(nullptr);
+}
+
+void CTextImporter::start(QIODevice* device, const QByteArray& codecName)
+{
+    Q_ASSERT(device && !device->parent());
+    Q_ASSERT(!isRunning());
+    m_cancel.store(0);
+    m_running.store(1);
+    device->moveToThread(&m_thread);
+    m_device.store(device);
+    m_thread.start();
+    //在工作线程中执行，device的事件也在该线程处理
+    QMetaObject::invokeMethod(device, [this, codecName]() { run(codecName); }, Qt::QueuedConnection);
+}
+
+void CTextImporter::run(const QByteArray& codecName)
+{
+    TRACE_SCOPE(lcTraceImport, "CTextImporter::run");
+    QIODevice* device = m_device.fetchAndStoreOrdered(nullptr);
+    if (!device)
+        return;
+    QScopedPointer<QIODevice> guard(device);
+    if (!device->isOpen() && !device->open(QIODevice::ReadOnly)) {
+        m_running.store(0);
+        emit finished(false, device->errorString());
+        return;
+    }
+    QTextCodec* codec = (codecName.isEmpty() ? nullptr : QTextCodec::codecForName(codecName));
+    QScopedPointer<QTextDecoder> decoder;
+    QString pending;
+    QString error;
+    QByteArray data;
+    while (!m_cancel.load()) {
+        data.resize(ChunkBytes);
+        const qint64 n = device->read(data.data(), ChunkBytes);
+        if (n < 0) {
+            error = device->errorString();
+            break;
+        }
+        data.resize(int(n));
+        if (data.isEmpty()) {
+            if (!device->isSequential() || device->atEnd())
+                break;
+            if (device->waitForReadyRead(READ_TIMEOUT_MSECS))
+                continue;
+            //超时或出错：设备仍可读却等不到数据
+            if (device->isOpen() && !device->atEnd())
+                error = device->errorString();
+            break;
+        }
+        if (!decoder) {
+            //第一块决定编码
+            if (!codec)
+                codec = QTextCodec::codecForUtfText(data, QTextCodec::codecForName("UTF-8"));
+            decoder.reset(codec->makeDecoder());
+        }
+        QString text = pending + decoder->toUnicode(data);
+        pending.clear();
+        //\r留到下一块，和后面的\n一起处理
+        if (text.endsWith(QChar('\r'))) {
+            pending = QStringLiteral("\r");
+            text.chop(1);
+        }
+        if (!text.isEmpty())
+            emit chunkReady(text);
+    }
+    const bool cancelled = (m_cancel.load() != 0);
+    if (!cancelled && error.isEmpty() && !pending.isEmpty())
+        emit chunkReady(pending);
+    m_running.store(0);
+    emit finished(!cancelled && error.isEmpty(), cancelled ? QString() : error);
+}
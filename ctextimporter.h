@@ -0,0 +1,42 @@
+#ifndef CTEXTIMPORTER_H
+#define CTEXTIMPORTER_H
+
+#include <QObject>
+#include <QThread>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+
+class QIODevice;
+
+//后台导入纯文本：在工作线程中分块读取device并用QTextDecoder解码，
+//每块结果通过chunkReady送到接收方线程，多字节字符和\r\n跨块时不会被拆开
+class CTextImporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CTextImporter(QObject* parent = nullptr);
+    //取消并等待工作线程结束
+    ~CTextImporter();
+
+    //接管device（不能有父对象，未打开时以只读方式打开）
+    //codecName为空时按BOM判断，没有BOM按UTF-8
+    void start(QIODevice* device, const QByteArray& codecName = QByteArray());
+    void cancel() { m_cancel.store(1); }
+    bool isRunning() const { return m_running.load() != 0; }
+
+    //每次读取的字节数
+    static const int ChunkBytes = 256 * 1024;
+signals:
+    void chunkReady(const QString& text);
+    //取消时ok为false，error为空；打开或读取失败时error为设备的错误信息
+    void finished(bool ok, const QString& error);
+private:
+    void run(const QByteArray& codecName);
+private:
+    QThread              m_thread;
+    QAtomicPointer<QIODevice> m_device;     //尚未被run()取走的设备，run()没有执行时由析构删除
+    QAtomicInteger<int>  m_cancel;
+    QAtomicInteger<int>  m_running;
+};
+
+#endif // CTEXTIMPORTER_H
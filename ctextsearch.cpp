@@ -0,0 +1,209 @@
+#include "ctextsearch.h"
+#include <QtAlgorithms>
+#include <cstring>
+#include "ctrace.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//不区分大小写时，c的全部写法是否就是toLower、toUpper两种
+//k、s另有开尔文符号、长s折叠到它们；其他非ASCII字符只放行没有大小写的中日韩文字
+static bool hasSimpleCase(ushort c)
+{
+    if (c < 0x80)
+        return c != 'k' && c != 'K' && c != 's' && c != 'S';
+    return (c >= 0x2E80 && c < 0xA640) || (c >= 0xAC00 && c < 0xD7A4);
+}
+
+CTextSearch::CTextSearch(const QString& pattern, Qt::CaseSensitivity cs)
+{
+    setPattern(pattern, cs);
+}
+
+void CTextSearch::setPattern(const QString& pattern, Qt::CaseSensitivity cs)
+{
+    m_pattern = pattern;
+    m_cs = cs;
+    m_filter = false;
+    if (pattern.isEmpty())
+        return;
+    const ushort f = pattern.at(0).unicode();
+    const ushort l = pattern.at(pattern.size() - 1).unicode();
+    if (cs == Qt::CaseSensitive) {
+        m_first[0] = m_first[1] = f;
+        m_last[0] = m_last[1] = l;
+        m_filter = true;
+    } else if (hasSimpleCase(f) && hasSimpleCase(l)) {
+        m_first[0] = QChar::toLower(f);
+        m_first[1] = QChar::toUpper(f);
+        m_last[0] = QChar::toLower(l);
+        m_last[1] = QChar::toUpper(l);
+        m_filter = true;
+    }
+}
+
+bool CTextSearch::matchesAt(const ushort* p) const
+{
+    const int m = m_pattern.size();
+    if (m_cs == Qt::CaseSensitive)
+        return std::memcmp(p, m_pattern.utf16(), size_t(m) * sizeof(ushort)) == 0;
+    return QString::fromRawData(reinterpret_cast<const QChar*>(p), m).compare(m_pattern, Qt::CaseInsensitive) == 0;
+}
+
+int CTextSearch::indexIn(QStringView s, int from) const
+{
+    const int m = m_pattern.size();
+    const int last = int(s.size()) - m;     //最后一个可能的起点
+    if (m == 0 || from < 0 || from > last)
+        return -1;
+    const ushort* p = reinterpret_cast<const ushort*>(s.utf16());
+    int i = from;
+    if (!m_filter) {
+        for (; i <= last; ++i) {
+            if (matchesAt(p + i))
+                return i;
+        }
+        return -1;
+    }
+#ifdef __SSE2__
+    //起点和终点各取8个单元比较，两处都可能相等的位置才是候选
+    const __m128i f0 = _mm_set1_epi16(short(m_first[0]));
+    const __m128i f1 = _mm_set1_epi16(short(m_first[1]));
+    const __m128i l0 = _mm_set1_epi16(short(m_last[0]));
+    const __m128i l1 = _mm_set1_epi16(short(m_last[1]));
+    for (; i + 8 <= last + 1; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + m - 1));
+        const __m128i fa = _mm_or_si128(_mm_cmpeq_epi16(a, f0), _mm_cmpeq_epi16(a, f1));
+        const __m128i lb = _mm_or_si128(_mm_cmpeq_epi16(b, l0), _mm_cmpeq_epi16(b, l1));
+        uint mask = uint(_mm_movemask_epi8(_mm_and_si128(fa, lb)));
+        while (mask) {
+            //每个单元占两位
+            const int k = int(qCountTrailingZeroBits(mask)) / 2;
+            if (matchesAt(p + i + k))
+                return i + k;
+            mask &= ~(3u << (k * 2));
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        const ushort a = p[i];
+        const ushort b = p[i + m - 1];
+        if ((a == m_first[0] || a == m_first[1]) && (b == m_last[0] || b == m_last[1]) && matchesAt(p + i))
+            return i;
+    }
+    return -1;
+}
+
+void CTextSearch::findInColumn(const VerticalTextDocument& doc, int col, QVector<STextRange>* matches) const
+{
+    const QString s = doc.text(col);
+    const int m = m_pattern.size();
+    for (int i = indexIn(QStringView(s)); i >= 0; i = indexIn(QStringView(s), i + m)) {
+        STextRange r;
+        r.startCol = r.endCol = col;
+        r.startPos = i;
+        r.endPos = i + m;
+        matches->append(r);
+    }
+}
+
+QVector<STextRange> CTextSearch::findAll(const VerticalTextDocument& doc, int firstCol, int lastCol) const
+{
+    TRACE_SCOPE(lcTraceSearch, "CTextSearch::findAll");
+    QVector<STextRange> matches;
+    if (!isValid())
+        return matches;
+    if (lastCol < 0 || lastCol >= doc.columnCount())
+        lastCol = doc.columnCount() - 1;
+    for (int col = qMax(0, firstCol); col <= lastCol; ++col) {
+        findInColumn(doc, col, &matches);
+    }
+    return matches;
+}
+
+STextRange CTextSearch::findNext(const VerticalTextDocument& doc, int col, int pos) const
+{
+    STextRange r;
+    if (!isValid())
+        return r;
+    const int n = doc.columnCount();
+    col = qBound(0, col, n - 1);
+    //多扫一次起点所在列，覆盖起点之前的部分
+    for (int k = 0; k <= n; ++k) {
+        const int c = (col + k) % n;
+        const QString s = doc.text(c);
+        const int i = indexIn(QStringView(s), k == 0 ? pos : 0);
+        if (i >= 0) {
+            r.startCol = r.endCol = c;
+            r.startPos = i;
+            r.endPos = i + m_pattern.size();
+            return r;
+        }
+    }
+    return r;
+}
+
+STextRange CTextSearch::findPrevious(const VerticalTextDocument& doc, int col, int pos) const
+{
+    STextRange r;
+    if (!isValid())
+        return r;
+    const int n = doc.columnCount();
+    col = qBound(0, col, n - 1);
+    for (int k = 0; k <= n; ++k) {
+        const int c = ((col - k) % n + n) % n;
+        QVector<STextRange> found;
+        findInColumn(doc, c, &found);
+        for (int j = found.size() - 1; j >= 0; --j) {
+            //回到起点列时只取起点之前的部分
+            if (k == 0 && found.at(j).endPos > pos)
+                continue;
+            if (k == n && found.at(j).endPos <= pos)
+                continue;
+            return found.at(j);
+        }
+    }
+    return r;
+}
+
+bool CTextSearch::matches(const VerticalTextDocument& doc, const STextRange& r) const
+{
+    if (!isValid() || r.startCol != r.endCol || r.endPos - r.startPos != m_pattern.size()
+            || r.startCol < 0 || r.startCol >= doc.columnCount())
+        return false;
+    const QString s = doc.text(r.startCol);
+    return r.startPos >= 0 && r.endPos <= s.size() && matchesAt(s.utf16() + r.startPos);
+}
+
+void CTextSearch::replaceAll(VerticalTextDocument* doc, const QVector<STextRange>& matches, const QString& after,
+                             int* firstCol, int* lastCol)
+{
+    TRACE_SCOPE(lcTraceSearch, "CTextSearch::replaceAll");
+    Q_ASSERT(!after.contains(QChar('\n')));
+    if (firstCol) *firstCol = (matches.isEmpty() ? 0 : matches.constFirst().startCol);
+    if (lastCol) *lastCol = (matches.isEmpty() ? -1 : matches.constLast().startCol);
+    int i = 0;
+    while (i < matches.size()) {
+        //同一列的匹配一起替换
+        const int col = matches.at(i).startCol;
+        const QString s = doc->text(col);
+        const QVector<int> sf = doc->formats(col);
+        QString t;
+        QVector<int> f;
+        t.reserve(s.size());
+        f.reserve(s.size());
+        int done = 0;
+        for (; i < matches.size() && matches.at(i).startCol == col; ++i) {
+            const STextRange& r = matches.at(i);
+            t += s.midRef(done, r.startPos - done);
+            f += sf.mid(done, r.startPos - done);
+            t += after;
+            f += QVector<int>(after.size(), doc->formatAt(col, r.startPos));
+            done = r.endPos;
+        }
+        t += s.midRef(done);
+        f += sf.mid(done);
+        doc->setColumn(col, t, f);
+    }
+}
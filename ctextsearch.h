@@ -0,0 +1,50 @@
+#ifndef CTEXTSEARCH_H
+#define CTEXTSEARCH_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include "verticaltextdocument.h"
+
+//文档查找：逐列扫描，匹配不跨列（查找内容不能含换行），同一列中的匹配互不重叠
+//候选位置按首尾两个字符用SSE2每次筛选8个UTF-16单元，再完整比较
+//只读取文档，可在任意线程中对文档快照使用
+class CTextSearch
+{
+public:
+    explicit CTextSearch(const QString& pattern = QString(), Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+    void setPattern(const QString& pattern, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+    QString pattern() const { return m_pattern; }
+    Qt::CaseSensitivity caseSensitivity() const { return m_cs; }
+    bool isValid() const { return !m_pattern.isEmpty() && !m_pattern.contains(QChar('\n')); }
+
+    //s中from开始的第一个匹配，没有时返回-1
+    int indexIn(QStringView s, int from = 0) const;
+    //col列中的全部匹配，追加到matches
+    void findInColumn(const VerticalTextDocument& doc, int col, QVector<STextRange>* matches) const;
+    //[firstCol, lastCol]中的全部匹配，按位置排序；lastCol为-1时到最后一列
+    QVector<STextRange> findAll(const VerticalTextDocument& doc, int firstCol = 0, int lastCol = -1) const;
+    //(col, pos)之后的第一个匹配，到末尾后从头继续；没有时返回空范围
+    STextRange findNext(const VerticalTextDocument& doc, int col, int pos) const;
+    //结束位置不超过(col, pos)的最后一个匹配，到开头后从末尾继续
+    STextRange findPrevious(const VerticalTextDocument& doc, int col, int pos) const;
+    bool matches(const VerticalTextDocument& doc, const STextRange& r) const;
+
+    //把matches（findAll的结果）全部换成after（不能含换行），替换文字使用匹配首字符的格式
+    //每个涉及的列只重建一次，firstCol、lastCol返回修改过的列范围
+    static void replaceAll(VerticalTextDocument* doc, const QVector<STextRange>& matches, const QString& after,
+                           int* firstCol = nullptr, int* lastCol = nullptr);
+private:
+    bool matchesAt(const ushort* p) const;
+private:
+    QString              m_pattern;
+    Qt::CaseSensitivity  m_cs = Qt::CaseSensitive;
+    //首尾字符可能的取值（不区分大小写时为大小写两种）
+    ushort               m_first[2] = {0, 0};
+    ushort               m_last[2] = {0, 0};
+    //首尾字符的大小写只有上面两种写法时才能按字符筛选
+    bool                 m_filter = false;
+};
+
+#endif // CTEXTSEARCH_H
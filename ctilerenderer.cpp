@@ -0,0 +1,194 @@
+#include "ctilerenderer.h"
+#include <QPainter>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadStorage>
+#include <QtMath>
+#include <cmath>
+#include <functional>
+#include "ctrace.h"
+
+const int CTileRenderer::TileSize = 256;
+
+static const int DEFAULT_CACHE_LIMIT = 128 * 1024;     //KB
+static const QColor PLACEHOLDER_COLOR("#F0F0F0");
+
+//每个工作线程一个排版对象，字体缓存跨快照保留
+static QThreadStorage<VerticalTextLayout*> s_layouts;
+
+static VerticalTextLayout& threadLayout()
+{
+    if (!s_layouts.hasLocalData()) {
+        VerticalTextLayout* layout = new VerticalTextLayout;
+        layout->setParallel(false);
+        s_layouts.setLocalData(layout);
+    }
+    return *s_layouts.localData();
+}
+
+CTileRenderer::CTileRenderer(QObject* parent):
+    QObject(parent)
+{
+    m_tiles.setMaxCost(DEFAULT_CACHE_LIMIT);
+    //留一个核心给界面线程
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+CTileRenderer::~CTileRenderer()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+QRectF CTileRenderer::tileRect(quint64 key)
+{
+    const int x = int(qint32(key >> 32));
+    const int y = int(qint32(key & 0xFFFFFFFF));
+    return QRectF(qreal(x) * TileSize, qreal(y) * TileSize, TileSize, TileSize);
+}
+
+void CTileRenderer::setSource(const VerticalTextDocument& doc, const VerticalTextLayout& layout)
+{
+    if (m_snapshot && m_snapshot->revision == layout.revision())
+        return;
+    TRACE_SCOPE(lcTracePaint, "CTileRenderer::setSource");
+    //文档隐式共享，度量结果直接复制，开销与列数无关的部分很小
+    QSharedPointer<SSnapshot> snapshot(new SSnapshot);
+    snapshot->doc = doc;
+    snapshot->bounds = layout.boundingRect();
+    snapshot->layout.assignMetrics(layout, &snapshot->doc);
+    snapshot->revision = layout.revision();
+    m_snapshot = snapshot;
+    //还没开始的旧任务不再需要
+    m_pool.clear();
+    m_pending.clear();
+}
+
+void CTileRenderer::clear()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+    m_pending.clear();
+    m_tiles.clear();
+    m_snapshot.clear();
+}
+
+void CTileRenderer::paint(QPainter* painter, const QRectF& exposed, qreal scale)
+{
+    if (!m_snapshot)
+        return;
+    //按2的幂取整，缩放时不必每次重绘
+    scale = qBound(0.125, qPow(2, qRound(std::log2(scale))), 8.0);
+    if (scale != m_scale) {
+        m_scale = scale;
+        m_pool.clear();
+        m_pending.clear();
+    }
+
+    const QRectF area = (exposed.isNull() ? m_snapshot->bounds : exposed.intersected(m_snapshot->bounds));
+    if (area.isEmpty())
+        return;
+    const int x0 = qFloor(area.left() / TileSize);
+    const int x1 = qCeil(area.right() / TileSize) - 1;
+    const int y0 = qFloor(area.top() / TileSize);
+    const int y1 = qCeil(area.bottom() / TileSize) - 1;
+
+    painter->save();
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+            const quint64 key = tileKey(x, y);
+            const QRectF r = tileRect(key);
+            const STile* tile = m_tiles.object(key);
+            if (tile) {
+                //旧版本的图块先显示，避免闪烁
+                painter->drawImage(r, tile->image);
+            } else {
+                painter->fillRect(r.intersected(area), PLACEHOLDER_COLOR);
+            }
+            if (!tile || tile->revision != m_snapshot->revision || tile->scale != m_scale)
+                request(key);
+        }
+    }
+    painter->restore();
+}
+
+namespace {
+class TileTask : public QRunnable
+{
+public:
+    typedef std::function<void(const QImage&)> Callback;
+
+    TileTask(const QSharedPointer<const void>& keepAlive, const VerticalTextDocument* doc,
+             const VerticalTextLayout* source, const QRectF& rect, qreal scale, const Callback& done):
+        m_keepAlive(keepAlive),
+        m_doc(doc),
+        m_source(source),
+        m_rect(rect),
+        m_scale(scale),
+        m_done(done)
+    {
+
+    }
+
+    void run() override {
+        TRACE_SCOPE(lcTracePaint, "CTileRenderer::renderTile");
+        VerticalTextLayout& layout = threadLayout();
+        layout.assignMetrics(*m_source, m_doc);
+        const int size = qCeil(m_rect.width() * m_scale);
+        QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        {
+            QPainter painter(&image);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setRenderHint(QPainter::TextAntialiasing);
+            painter.scale(m_scale, m_scale);
+            painter.translate(-m_rect.topLeft());
+            layout.draw(&painter, STextRange(), m_rect);
+        }
+        //不持有快照数据
+        layout.setDocument(nullptr);
+        m_done(image);
+    }
+private:
+    QSharedPointer<const void>  m_keepAlive;
+    const VerticalTextDocument* m_doc;
+    const VerticalTextLayout*   m_source;
+    QRectF                      m_rect;
+    qreal                       m_scale;
+    Callback                    m_done;
+};
+}
+
+void CTileRenderer::request(quint64 key)
+{
+    const int revision = m_snapshot->revision;
+    if (m_pending.value(key, -1) == revision)
+        return;
+    m_pending.insert(key, revision);
+
+    const qreal scale = m_scale;
+    const QSharedPointer<const SSnapshot> snapshot = m_snapshot;
+    m_pool.start(new TileTask(snapshot, &snapshot->doc, &snapshot->layout, tileRect(key), scale,
+                              [this, key, revision, scale](const QImage& image) {
+        //回到界面线程写入缓存
+        QMetaObject::invokeMethod(this, [this, key, revision, scale, image]() {
+            onTileRendered(key, revision, scale, image);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void CTileRenderer::onTileRendered(quint64 key, int revision, qreal scale, const QImage& image)
+{
+    if (m_pending.value(key, -1) == revision)
+        m_pending.remove(key);
+    const STile* old = m_tiles.object(key);
+    if (old && old->revision > revision)
+        return;
+    STile* tile = new STile;
+    tile->image = image;
+    tile->revision = revision;
+    tile->scale = scale;
+    m_tiles.insert(key, tile, qMax(1, int(image.sizeInBytes() / 1024)));
+    emit tileReady(tileRect(key));
+}
@@ -0,0 +1,62 @@
+#ifndef CTILERENDERER_H
+#define CTILERENDERER_H
+
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <QHash>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include "verticaltextlayout.h"
+
+class QPainter;
+
+//分块渲染：把item按固定大小切成图块，在工作线程中根据排版快照绘制到QImage
+//paint()只贴已完成的图块，未完成的显示占位（或上一版本的图块）并提交渲染
+class CTileRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CTileRenderer(QObject* parent = nullptr);
+    ~CTileRenderer();
+
+    //排版版本变化时生成新快照，layout必须已是doc的排版
+    void setSource(const VerticalTextDocument& doc, const VerticalTextLayout& layout);
+    //scale为item坐标到设备像素的缩放
+    void paint(QPainter* painter, const QRectF& exposed, qreal scale);
+    //缓存上限（KB）
+    void setCacheLimit(int kilobytes) { m_tiles.setMaxCost(kilobytes); }
+    void clear();
+
+    //图块边长（item坐标）
+    static const int TileSize;
+signals:
+    void tileReady(const QRectF& rect);
+private:
+    typedef struct SSnapshot{
+        VerticalTextDocument doc;
+        VerticalTextLayout   layout;
+        QRectF               bounds;
+        int                  revision = -1;
+    } SSnapshot;
+
+    typedef struct STile{
+        QImage  image;
+        int     revision = -1;
+        qreal   scale = 1;
+    } STile;
+
+    //图块坐标打包为key
+    static quint64 tileKey(int x, int y) { return (quint64(quint32(x)) << 32) | quint32(y); }
+    static QRectF tileRect(quint64 key);
+    void request(quint64 key);
+    void onTileRendered(quint64 key, int revision, qreal scale, const QImage& image);
+private:
+    QSharedPointer<const SSnapshot> m_snapshot;
+    QCache<quint64, STile>          m_tiles;        //按最近使用淘汰
+    QHash<quint64, int>             m_pending;      //正在渲染的图块及其版本
+    qreal                           m_scale = 1;
+    QThreadPool                     m_pool;
+};
+
+#endif // CTILERENDERER_H
@@ -0,0 +1,130 @@
+#include "ctrace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+Q_LOGGING_CATEGORY(lcTraceLayout, "verticaltext.layout", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTracePaint, "verticaltext.paint", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceHitTest, "verticaltext.hittest", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceUndo, "verticaltext.undo", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceImport, "verticaltext.import", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceExport, "verticaltext.export", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceSearch, "verticaltext.search", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcTraceEvent, "verticaltext.event", QtWarningMsg)
+
+namespace {
+typedef struct STraceEvent{
+    const char* category;
+    const char* name;
+    qint64      begin;
+    qint64      duration;
+    quintptr    thread;
+} STraceEvent;
+
+struct TraceState {
+    QElapsedTimer          clock;
+    QMutex                 mutex;
+    QAtomicInt             recording;
+    QString                fileName;
+    QVector<STraceEvent>   events;
+
+    TraceState() { clock.start(); }
+};
+
+TraceState& traceState()
+{
+    static TraceState state;
+    return state;
+}
+}
+
+bool CTraceRecorder::start(const QString& fileName)
+{
+    TraceState& t = traceState();
+    QMutexLocker locker(&t.mutex);
+    if (t.recording.loadAcquire())
+        return false;
+    t.fileName = fileName;
+    t.events.clear();
+    t.events.reserve(4096);
+    t.recording.storeRelease(1);
+    QLoggingCategory::setFilterRules(QStringLiteral("verticaltext.*.debug=true\n"
+                                                    "verticaltext.event.debug=false"));
+    return true;
+}
+
+void CTraceRecorder::stop()
+{
+    TraceState& t = traceState();
+    QVector<STraceEvent> events;
+    QString fileName;
+    {
+        QMutexLocker locker(&t.mutex);
+        if (!t.recording.loadAcquire())
+            return;
+        t.recording.storeRelease(0);
+        events.swap(t.events);
+        fileName = t.fileName;
+    }
+    QLoggingCategory::setFilterRules(QString());
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray array;
+    for (const STraceEvent& e : events) {
+        QJsonObject o;
+        o.insert(QStringLiteral("name"), QLatin1String(e.name));
+        o.insert(QStringLiteral("cat"), QLatin1String(e.category));
+        o.insert(QStringLiteral("ph"), QStringLiteral("X"));
+        o.insert(QStringLiteral("ts"), e.begin);
+        o.insert(QStringLiteral("dur"), e.duration);
+        o.insert(QStringLiteral("pid"), pid);
+        o.insert(QStringLiteral("tid"), qint64(e.thread));
+        array.append(o);
+    }
+    QJsonObject root;
+    root.insert(QStringLiteral("traceEvents"), array);
+    root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "trace: cannot write" << fileName;
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+}
+
+bool CTraceRecorder::isRecording()
+{
+    return traceState().recording.loadAcquire() != 0;
+}
+
+qint64 CTraceRecorder::now()
+{
+    return traceState().clock.nsecsElapsed() / 1000;
+}
+
+void CTraceRecorder::addComplete(const char* category, const char* name, qint64 begin, qint64 duration)
+{
+    TraceState& t = traceState();
+    const quintptr thread = quintptr(QThread::currentThreadId());
+    QMutexLocker locker(&t.mutex);
+    if (!t.recording.loadAcquire())
+        return;
+    t.events.append({category, name, begin, duration, thread});
+}
+
+void CTraceScope::finish()
+{
+    const qint64 duration = CTraceRecorder::now() - m_begin;
+    if (CTraceRecorder::isRecording()) {
+        CTraceRecorder::addComplete(m_category->categoryName(), m_name, m_begin, duration);
+    } else {
+        qCDebug((*m_category)) << m_name << duration << "us";
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef CTRACE_H
+#define CTRACE_H
+
+#include <QLoggingCategory>
+#include <QString>
+
+//跟踪分类，默认关闭，可用QT_LOGGING_RULES打开，例如"verticaltext.paint.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcTraceLayout)
+Q_DECLARE_LOGGING_CATEGORY(lcTracePaint)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceHitTest)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceUndo)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceImport)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceExport)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceSearch)
+Q_DECLARE_LOGGING_CATEGORY(lcTraceEvent)
+
+//记录为Chrome trace格式（chrome://tracing或Perfetto打开）
+class CTraceRecorder
+{
+public:
+    //开始记录并打开所有跟踪分类（事件分类除外），stop()时写入文件
+    static bool start(const QString& fileName);
+    static void stop();
+    static bool isRecording();
+    //进程内单调时钟，微秒
+    static qint64 now();
+    static void addComplete(const char* category, const char* name, qint64 begin, qint64 duration);
+};
+
+//作用域跟踪：分类关闭时只有一次判断
+class CTraceScope
+{
+public:
+    CTraceScope(const QLoggingCategory& category, const char* name):
+        m_category(category.isDebugEnabled() ? &category : nullptr),
+        m_name(name)
+    {
+        if (m_category)
+            m_begin = CTraceRecorder::now();
+    }
+    ~CTraceScope()
+    {
+        if (m_category)
+            finish();
+    }
+private:
+    void finish();
+private:
+    const QLoggingCategory* m_category;
+    const char*             m_name;
+    qint64                  m_begin = 0;
+};
+
+//定义VERTICALTEXT_NO_TRACE时跟踪点在编译期移除
+#ifdef VERTICALTEXT_NO_TRACE
+#  define TRACE_SCOPE(category, name) do {} while (0)
+#else
+#  define TRACE_CONCAT2(a, b) a##b
+#  define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#  define TRACE_SCOPE(category, name) CTraceScope TRACE_CONCAT(traceScope_, __LINE__)(category(), name)
+#endif
+
+#endif // CTRACE_H
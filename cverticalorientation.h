@@ -0,0 +1,200 @@
+#ifndef CVERTICALORIENTATION_H
+#define CVERTICALORIENTATION_H
+
+#include <QtGlobal>
+
+//竖排方向（UAX #50 Vertical_Orientation）：编译期由区间表生成每个UTF-16单元2位的查找表，查询O(1)
+//只覆盖基本多文种平面；代理项按直立处理（扩展汉字、表情等辅助平面字符大多直立）
+class CVerticalOrientation
+{
+public:
+    enum Type {
+        Upright = 0,            //U：直立
+        Rotated,                //R：顺时针旋转90度
+        TransformedUpright,     //Tu：需要竖排字形，没有时直立（小假名、句读点等）
+        TransformedRotated,     //Tr：需要竖排字形，没有时旋转（括号、长音符等）
+    };
+
+    static constexpr Type type(ushort c);
+    //没有竖排字形时需要旋转
+    static constexpr bool isSideways(ushort c) { return type(c) == Rotated || type(c) == TransformedRotated; }
+};
+
+namespace VerticalOrientationData {
+
+typedef struct SRange{
+    ushort  first;
+    ushort  last;
+    quint8  type;
+} SRange;
+
+//不在表中的字符为R；后面的区间覆盖前面的
+constexpr SRange RANGES[] = {
+    {0x00A7, 0x00A7, CVerticalOrientation::Upright},
+    {0x00A9, 0x00A9, CVerticalOrientation::Upright},
+    {0x00AE, 0x00AE, CVerticalOrientation::Upright},
+    {0x00B1, 0x00B1, CVerticalOrientation::Upright},
+    {0x00BC, 0x00BE, CVerticalOrientation::Upright},
+    {0x00D7, 0x00D7, CVerticalOrientation::Upright},
+    {0x00F7, 0x00F7, CVerticalOrientation::Upright},
+    {0x02EA, 0x02EB, CVerticalOrientation::Upright},
+    {0x1100, 0x11FF, CVerticalOrientation::Upright},    //谚文字母
+    {0x1401, 0x167F, CVerticalOrientation::Upright},    //加拿大原住民音节
+    {0x18B0, 0x18FF, CVerticalOrientation::Upright},
+    {0x2016, 0x2016, CVerticalOrientation::Upright},
+    {0x2020, 0x2021, CVerticalOrientation::Upright},
+    {0x2030, 0x2031, CVerticalOrientation::Upright},
+    {0x203B, 0x203C, CVerticalOrientation::Upright},
+    {0x2042, 0x2042, CVerticalOrientation::Upright},
+    {0x2047, 0x2049, CVerticalOrientation::Upright},
+    {0x2051, 0x2051, CVerticalOrientation::Upright},
+    {0x2065, 0x2065, CVerticalOrientation::Upright},
+    {0x20DD, 0x20E0, CVerticalOrientation::Upright},
+    {0x20E2, 0x20E4, CVerticalOrientation::Upright},
+    {0x2100, 0x2101, CVerticalOrientation::Upright},    //字母式符号
+    {0x2103, 0x2109, CVerticalOrientation::Upright},
+    {0x210F, 0x210F, CVerticalOrientation::Upright},
+    {0x2113, 0x2114, CVerticalOrientation::Upright},
+    {0x2116, 0x2117, CVerticalOrientation::Upright},
+    {0x211E, 0x2123, CVerticalOrientation::Upright},
+    {0x2125, 0x2125, CVerticalOrientation::Upright},
+    {0x2127, 0x2127, CVerticalOrientation::Upright},
+    {0x2129, 0x2129, CVerticalOrientation::Upright},
+    {0x212E, 0x212E, CVerticalOrientation::Upright},
+    {0x2135, 0x213F, CVerticalOrientation::Upright},
+    {0x2145, 0x214A, CVerticalOrientation::Upright},
+    {0x214C, 0x214D, CVerticalOrientation::Upright},
+    {0x214F, 0x2189, CVerticalOrientation::Upright},    //数字形式、罗马数字
+    {0x218C, 0x218F, CVerticalOrientation::Upright},
+    {0x221E, 0x221E, CVerticalOrientation::Upright},
+    {0x2234, 0x2235, CVerticalOrientation::Upright},
+    {0x2300, 0x2307, CVerticalOrientation::Upright},    //技术符号
+    {0x230C, 0x231F, CVerticalOrientation::Upright},
+    {0x2324, 0x232B, CVerticalOrientation::Upright},
+    {0x237D, 0x239A, CVerticalOrientation::Upright},
+    {0x23BE, 0x23CD, CVerticalOrientation::Upright},
+    {0x23CF, 0x23CF, CVerticalOrientation::Upright},
+    {0x23D1, 0x23DB, CVerticalOrientation::Upright},
+    {0x23E2, 0x2422, CVerticalOrientation::Upright},
+    {0x2424, 0x24FF, CVerticalOrientation::Upright},    //带圈字母数字
+    {0x25A0, 0x2767, CVerticalOrientation::Upright},    //几何图形、杂项符号、装饰符号
+    {0x2776, 0x2793, CVerticalOrientation::Upright},
+    {0x2B12, 0x2B2F, CVerticalOrientation::Upright},
+    {0x2B50, 0x2B59, CVerticalOrientation::Upright},
+    {0x2BB8, 0x2BFF, CVerticalOrientation::Upright},
+    {0x2E50, 0x2E51, CVerticalOrientation::Upright},
+    {0x2E80, 0xA4CF, CVerticalOrientation::Upright},    //中日韩部首至彝文
+    {0xA960, 0xA97F, CVerticalOrientation::Upright},
+    {0xAC00, 0xD7FF, CVerticalOrientation::Upright},    //谚文音节
+    {0xD800, 0xDFFF, CVerticalOrientation::Upright},    //代理项
+    {0xE000, 0xFAFF, CVerticalOrientation::Upright},    //私用区、兼容汉字
+    {0xFE10, 0xFE1F, CVerticalOrientation::Upright},    //竖排形式
+    {0xFE30, 0xFE48, CVerticalOrientation::Upright},
+    {0xFE50, 0xFE57, CVerticalOrientation::Upright},
+    {0xFE5F, 0xFE62, CVerticalOrientation::Upright},
+    {0xFE67, 0xFE6F, CVerticalOrientation::Upright},
+    {0xFF01, 0xFF60, CVerticalOrientation::Upright},    //全角ASCII
+    {0xFFE0, 0xFFE7, CVerticalOrientation::Upright},
+    {0xFFF0, 0xFFF8, CVerticalOrientation::Upright},
+    {0xFFFC, 0xFFFD, CVerticalOrientation::Upright},
+
+    {0x3001, 0x3002, CVerticalOrientation::TransformedUpright},     //、。
+    {0x3041, 0x3041, CVerticalOrientation::TransformedUpright},     //小平假名
+    {0x3043, 0x3043, CVerticalOrientation::TransformedUpright},
+    {0x3045, 0x3045, CVerticalOrientation::TransformedUpright},
+    {0x3047, 0x3047, CVerticalOrientation::TransformedUpright},
+    {0x3049, 0x3049, CVerticalOrientation::TransformedUpright},
+    {0x3063, 0x3063, CVerticalOrientation::TransformedUpright},
+    {0x3083, 0x3083, CVerticalOrientation::TransformedUpright},
+    {0x3085, 0x3085, CVerticalOrientation::TransformedUpright},
+    {0x3087, 0x3087, CVerticalOrientation::TransformedUpright},
+    {0x308E, 0x308E, CVerticalOrientation::TransformedUpright},
+    {0x3095, 0x3096, CVerticalOrientation::TransformedUpright},
+    {0x309B, 0x309C, CVerticalOrientation::TransformedUpright},
+    {0x30A1, 0x30A1, CVerticalOrientation::TransformedUpright},     //小片假名
+    {0x30A3, 0x30A3, CVerticalOrientation::TransformedUpright},
+    {0x30A5, 0x30A5, CVerticalOrientation::TransformedUpright},
+    {0x30A7, 0x30A7, CVerticalOrientation::TransformedUpright},
+    {0x30A9, 0x30A9, CVerticalOrientation::TransformedUpright},
+    {0x30C3, 0x30C3, CVerticalOrientation::TransformedUpright},
+    {0x30E3, 0x30E3, CVerticalOrientation::TransformedUpright},
+    {0x30E5, 0x30E5, CVerticalOrientation::TransformedUpright},
+    {0x30E7, 0x30E7, CVerticalOrientation::TransformedUpright},
+    {0x30EE, 0x30EE, CVerticalOrientation::TransformedUpright},
+    {0x30F5, 0x30F6, CVerticalOrientation::TransformedUpright},
+    {0x31F0, 0x31FF, CVerticalOrientation::TransformedUpright},
+    {0x3300, 0x3357, CVerticalOrientation::TransformedUpright},     //方形片假名词
+    {0x337B, 0x337F, CVerticalOrientation::TransformedUpright},
+    {0xFE50, 0xFE52, CVerticalOrientation::TransformedUpright},
+    {0xFF01, 0xFF01, CVerticalOrientation::TransformedUpright},     //！，．？
+    {0xFF0C, 0xFF0C, CVerticalOrientation::TransformedUpright},
+    {0xFF0E, 0xFF0E, CVerticalOrientation::TransformedUpright},
+    {0xFF1F, 0xFF1F, CVerticalOrientation::TransformedUpright},
+
+    {0x2329, 0x232A, CVerticalOrientation::TransformedRotated},
+    {0x2E3A, 0x2E3B, CVerticalOrientation::TransformedRotated},     //两字线、三字线
+    {0x3008, 0x3011, CVerticalOrientation::TransformedRotated},     //括号
+    {0x3014, 0x301F, CVerticalOrientation::TransformedRotated},     //括号、波浪线
+    {0x3030, 0x3030, CVerticalOrientation::TransformedRotated},
+    {0x30A0, 0x30A0, CVerticalOrientation::TransformedRotated},
+    {0x30FC, 0x30FC, CVerticalOrientation::TransformedRotated},     //长音符
+    {0xFE59, 0xFE5E, CVerticalOrientation::TransformedRotated},
+    {0xFF08, 0xFF09, CVerticalOrientation::TransformedRotated},     //全角括号、连字符、冒号等
+    {0xFF0D, 0xFF0D, CVerticalOrientation::TransformedRotated},
+    {0xFF1A, 0xFF1E, CVerticalOrientation::TransformedRotated},
+    {0xFF3B, 0xFF3B, CVerticalOrientation::TransformedRotated},
+    {0xFF3D, 0xFF3D, CVerticalOrientation::TransformedRotated},
+    {0xFF3F, 0xFF3F, CVerticalOrientation::TransformedRotated},
+    {0xFF5B, 0xFF60, CVerticalOrientation::TransformedRotated},
+    {0xFFE3, 0xFFE3, CVerticalOrientation::TransformedRotated},
+};
+
+//每字节4个字符
+typedef struct STable{
+    quint8 bits[0x10000 / 4];
+} STable;
+
+constexpr void setType(STable& t, int c, quint8 type)
+{
+    const int shift = (c & 3) * 2;
+    t.bits[c >> 2] = quint8((t.bits[c >> 2] & ~(3 << shift)) | (type << shift));
+}
+
+constexpr STable buildTable()
+{
+    STable t{};
+    for (int i = 0; i < 0x10000 / 4; ++i) {
+        t.bits[i] = 0x55;       //全部为R
+    }
+    for (const SRange& r : RANGES) {
+        int c = r.first;
+        //对齐的整字节一次写入，减少编译期求值的步数
+        for (; c <= r.last && (c & 3) != 0; ++c) {
+            setType(t, c, r.type);
+        }
+        const quint8 fill = quint8(r.type * 0x55);
+        for (; c + 3 <= r.last; c += 4) {
+            t.bits[c >> 2] = fill;
+        }
+        for (; c <= r.last; ++c) {
+            setType(t, c, r.type);
+        }
+    }
+    return t;
+}
+
+inline constexpr STable TABLE = buildTable();
+
+} // namespace VerticalOrientationData
+
+constexpr CVerticalOrientation::Type CVerticalOrientation::type(ushort c)
+{
+    return Type((VerticalOrientationData::TABLE.bits[c >> 2] >> ((c & 3) * 2)) & 3);
+}
+
+static_assert(CVerticalOrientation::type(u'A') == CVerticalOrientation::Rotated, "Latin is rotated");
+static_assert(CVerticalOrientation::type(u'\u4E2D') == CVerticalOrientation::Upright, "Han is upright");
+static_assert(CVerticalOrientation::type(u'\u3002') == CVerticalOrientation::TransformedUpright, "ideographic full stop");
+static_assert(CVerticalOrientation::type(u'\u300C') == CVerticalOrientation::TransformedRotated, "corner bracket");
+
+#endif // CVERTICALORIENTATION_H
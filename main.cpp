@@ -11,6 +11,7 @@
 #include <QTextDocument>
 #include "widget.h"
 #include "cgraphicsedit.h"
+#include "ctrace.h"
 #include <QFontComboBox>
 
 void setTextCodec()
@@ -36,8 +37,15 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     setTextCodec();
 
+    //设置VERTICALTEXT_TRACE_FILE时记录Chrome trace，退出时写入
+    const QString traceFile = qEnvironmentVariable("VERTICALTEXT_TRACE_FILE");
+    if (!traceFile.isEmpty())
+        CTraceRecorder::start(traceFile);
+
     Widget w;
     w.show();
 
-    return a.exec();
+    const int ret = a.exec();
+    CTraceRecorder::stop();
+    return ret;
 }
@@ -0,0 +1,74 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include "cbatchrenderer.h"
+#include "ctrace.h"
+
+//命令行批量渲染：vtrender [-o 目录] [--horizontal] [--align 对齐] [--scale 倍数] [--threads 线程数] 文件...
+int main(int argc, char *argv[])
+{
+    //无显示环境也能运行
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName(QStringLiteral("vtrender"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Render vertical text documents (.html, .vtd, plain text) to PNG."));
+    parser.addHelpOption();
+    QCommandLineOption outputOption({"o", "output"}, QStringLiteral("Output directory."), QStringLiteral("dir"), QStringLiteral("."));
+    QCommandLineOption horizontalOption(QStringLiteral("horizontal"), QStringLiteral("Lay out text horizontally."));
+    QCommandLineOption alignOption(QStringLiteral("align"), QStringLiteral("top, center, bottom, left, right or hcenter."), QStringLiteral("alignment"));
+    QCommandLineOption scaleOption(QStringLiteral("scale"), QStringLiteral("Device pixels per item unit."), QStringLiteral("factor"), QStringLiteral("1"));
+    QCommandLineOption threadsOption(QStringLiteral("threads"), QStringLiteral("Worker threads (default: all cores)."), QStringLiteral("count"), QStringLiteral("0"));
+    QCommandLineOption backgroundOption(QStringLiteral("background"), QStringLiteral("Background color, e.g. white or transparent."), QStringLiteral("color"), QStringLiteral("white"));
+    QCommandLineOption traceOption(QStringLiteral("trace"), QStringLiteral("Write a Chrome trace to file."), QStringLiteral("file"));
+    parser.addOptions({outputOption, horizontalOption, alignOption, scaleOption, threadsOption, backgroundOption, traceOption});
+    parser.addPositionalArgument(QStringLiteral("files"), QStringLiteral("Documents to render."), QStringLiteral("files..."));
+    parser.process(app);
+
+    const QStringList inputs = parser.positionalArguments();
+    if (inputs.isEmpty())
+        parser.showHelp(1);
+
+    SRenderOptions options;
+    if (parser.isSet(horizontalOption)) {
+        options.orientation = VerticalTextLayout::Horizontal;
+        options.alignment = VerticalTextLayout::AlignLeft;
+    }
+    if (parser.isSet(alignOption)) {
+        static const QStringList names = {"top", "center", "bottom", "left", "right", "hcenter"};
+        const int index = names.indexOf(parser.value(alignOption).toLower());
+        if (index < 0)
+            parser.showHelp(1);
+        options.alignment = index;
+    }
+    options.scale = qMax(0.01, parser.value(scaleOption).toDouble());
+    options.background = QColor(parser.value(backgroundOption));
+
+    if (parser.isSet(traceOption))
+        CTraceRecorder::start(parser.value(traceOption));
+
+    CBatchRenderer renderer(options);
+    renderer.setMaxThreadCount(parser.value(threadsOption).toInt());
+
+    QElapsedTimer timer;
+    timer.start();
+    QStringList errors;
+    const int done = renderer.renderFiles(inputs, parser.value(outputOption), &errors);
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+
+    CTraceRecorder::stop();
+
+    QTextStream err(stderr);
+    for (const QString& e : errors) {
+        err << e << '\n';
+    }
+    QTextStream out(stdout);
+    out << QStringLiteral("rendered %1/%2 documents in %3 ms (%4 docs/s, %5 threads)")
+           .arg(done).arg(inputs.size()).arg(elapsed)
+           .arg(done * 1000.0 / elapsed, 0, 'f', 1)
+           .arg(renderer.maxThreadCount()) << '\n';
+    return errors.isEmpty() ? 0 : 2;
+}
@@ -0,0 +1,30 @@
+QT       += core gui concurrent
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = vtrender
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../cbatchrenderer.cpp \
+    ../cglyphcache.cpp \
+    ../cmappedtextfile.cpp \
+    ../cshapecache.cpp \
+    ../ctrace.cpp \
+    ../scharformat.cpp \
+    ../verticaltextdocument.cpp \
+    ../verticaltextlayout.cpp
+
+HEADERS += \
+    ../cbatchrenderer.h \
+    ../cglyphcache.h \
+    ../cmappedtextfile.h \
+    ../cshapecache.h \
+    ../ctrace.h \
+    ../cverticalorientation.h \
+    ../scharformat.h \
+    ../verticaltextdocument.h \
+    ../verticaltextlayout.h
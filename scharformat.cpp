@@ -0,0 +1,74 @@
+#include "scharformat.h"
+#include <QReadWriteLock>
+#include <QVector>
+
+namespace {
+struct FormatTable {
+    QReadWriteLock            lock;
+    QVector<SCharFormat>      formats;
+    QHash<SCharFormat, int>   ids;
+};
+
+FormatTable& formatTable()
+{
+    static FormatTable table;
+    return table;
+}
+}
+
+int CFormatRegistry::intern(const SCharFormat& f)
+{
+    FormatTable& t = formatTable();
+    {
+        QReadLocker locker(&t.lock);
+        auto it = t.ids.constFind(f);
+        if (it != t.ids.constEnd())
+            return it.value();
+    }
+    QWriteLocker locker(&t.lock);
+    auto it = t.ids.constFind(f);
+    if (it != t.ids.constEnd())
+        return it.value();
+    const int id = t.formats.size();
+    t.formats.append(f);
+    t.ids.insert(f, id);
+    return id;
+}
+
+SCharFormat CFormatRegistry::format(int id)
+{
+    FormatTable& t = formatTable();
+    QReadLocker locker(&t.lock);
+    if (id < 0 || id >= t.formats.size())
+        return SCharFormat();
+    return t.formats.at(id);
+}
+
+int CFormatRegistry::count()
+{
+    FormatTable& t = formatTable();
+    QReadLocker locker(&t.lock);
+    return t.formats.size();
+}
+
+QDataStream& operator<<(QDataStream& out, const SCharFormat& f)
+{
+    const quint8 flags = quint8(f.bold) | quint8(f.italic) << 1 | quint8(f.overline) << 2 |
+                         quint8(f.underline) << 3 | quint8(f.strikeOut) << 4;
+    out << f.fontText << f.fontColor << qint32(f.fontSize) << flags << f.letterSpacing;
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, SCharFormat& f)
+{
+    qint32 size = 0;
+    quint8 flags = 0;
+    in >> f.fontText >> f.fontColor >> size >> flags >> f.letterSpacing;
+    f.fontSize = size;
+    f.bold = flags & 1;
+    f.italic = flags & 2;
+    f.overline = flags & 4;
+    f.underline = flags & 8;
+    f.strikeOut = flags & 16;
+    return in;
+}
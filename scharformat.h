@@ -0,0 +1,83 @@
+#ifndef SCHARFORMAT_H
+#define SCHARFORMAT_H
+
+#include <QFont>
+#include <QColor>
+#include <QString>
+#include <QHash>
+#include <QDataStream>
+
+typedef struct SCharFormat{
+    QString  fontText = "MicroSoft YaHei";
+    QColor   fontColor = Qt::black;
+    int      fontSize = 10;
+    bool     bold = false;
+    bool     italic = false;
+    bool     overline = false;
+    bool     underline = false;
+    bool     strikeOut = false;
+    qreal    letterSpacing = 0;
+
+    void setFont(QFont* f) const {
+        f->setFamily(fontText);
+        f->setBold(bold);
+        f->setItalic(italic);
+        f->setOverline(overline);
+        f->setPointSize(fontSize);
+        f->setUnderline(underline);
+        f->setStrikeOut(strikeOut);
+        f->setLetterSpacing(QFont::AbsoluteSpacing, letterSpacing);
+    }
+
+    void fromFont(const QFont& f) {
+        fontText = f.family();
+        fontSize = f.pointSize();
+        //HTML中以px指定的字号没有点数，按96dpi换算（与QTextDocument一致）
+        if (fontSize <= 0 && f.pixelSize() > 0)
+            fontSize = qMax(1, qRound(f.pixelSize() * 72.0 / 96.0));
+        bold = f.bold();
+        italic = f.italic();
+        overline = f.overline();
+        underline = f.underline();
+        strikeOut = f.strikeOut();
+        letterSpacing = f.letterSpacing();
+    }
+
+    bool operator==(const SCharFormat& o) const {
+        return fontSize == o.fontSize && bold == o.bold && italic == o.italic &&
+               overline == o.overline && underline == o.underline && strikeOut == o.strikeOut &&
+               letterSpacing == o.letterSpacing && fontColor == o.fontColor && fontText == o.fontText;
+    }
+    bool operator!=(const SCharFormat& o) const { return !(*this == o); }
+} SCharFormat;
+
+inline uint qHash(const SCharFormat& f, uint seed = 0)
+{
+    uint h = qHash(f.fontText, seed);
+    h = h * 31 + f.fontColor.rgba();
+    h = h * 31 + uint(f.fontSize);
+    h = h * 31 + (uint(f.bold) | uint(f.italic) << 1 | uint(f.overline) << 2 |
+                  uint(f.underline) << 3 | uint(f.strikeOut) << 4);
+    h = h * 31 + qHash(f.letterSpacing);
+    return h;
+}
+
+QDataStream& operator<<(QDataStream& out, const SCharFormat& f);
+QDataStream& operator>>(QDataStream& in, SCharFormat& f);
+
+//带格式的文本片段，formatId为-1时使用当前输入格式
+typedef struct STextRun{
+    QString  text;
+    int      formatId = -1;
+} STextRun;
+
+//全局格式表，相同格式共用一个ID（线程安全）
+class CFormatRegistry
+{
+public:
+    static int intern(const SCharFormat& f);
+    static SCharFormat format(int id);
+    static int count();
+};
+
+#endif // SCHARFORMAT_H
@@ -0,0 +1,34 @@
+#ifndef EDITFIXTURE_H
+#define EDITFIXTURE_H
+
+#include <QGraphicsScene>
+#include <QKeyEvent>
+#include <QKeySequence>
+#include "cgraphicsedit.h"
+
+//测试夹具：场景中的编辑框，事件通过场景发送
+typedef struct SEditFixture{
+    QGraphicsScene  scene;
+    CGraphicsEdit*  edit;
+
+    explicit SEditFixture(const VerticalTextDocument& doc = VerticalTextDocument()) : edit(new CGraphicsEdit) {
+        scene.addItem(edit);
+        edit->setTextInteractionFlags(Qt::TextEditorInteraction);
+        edit->updateData(doc, 0, 0);
+    }
+    void key(int key, const QString& text = QString(), Qt::KeyboardModifiers modifiers = Qt::NoModifier) {
+        QKeyEvent e(QEvent::KeyPress, key, modifiers, text);
+        scene.sendEvent(edit, &e);
+    }
+    void shortcut(QKeySequence::StandardKey standardKey) {
+        const QList<QKeySequence> bindings = QKeySequence::keyBindings(standardKey);
+        if (bindings.isEmpty())
+            return;
+        const int combo = bindings.first()[0];
+        key(combo & ~Qt::KeyboardModifierMask, QString(), Qt::KeyboardModifiers(combo & Qt::KeyboardModifierMask));
+    }
+    int length() const { return edit->text().length(); }
+    QRectF bounds() const { return static_cast<const QGraphicsItem*>(edit)->boundingRect(); }
+} SEditFixture;
+
+#endif // EDITFIXTURE_H
@@ -0,0 +1,11 @@
+QT       += core gui widgets testlib concurrent
+
+CONFIG += c++17 testcase
+CONFIG -= app_bundle
+
+TARGET = tst_verticaltext
+
+include(verticaltext.pri)
+
+SOURCES += \
+    tst_verticaltext.cpp
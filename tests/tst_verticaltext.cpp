@@ -0,0 +1,763 @@
+#if defined(_MSC_VER) && (_MSC_VER >= 1600)
+# pragma execution_character_set("utf-8")
+#endif
+
+#include <QtTest>
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QThread>
+#include <QRandomGenerator>
+#include <QClipboard>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QTemporaryFile>
+#include "cgraphicsedit.h"
+#include "editfixture.h"
+#include "cboundaryindex.h"
+#include "cmpscqueue.h"
+#include "ctextimporter.h"
+#include "ctextsearch.h"
+
+//正确性测试：与基准测试使用同一组源文件，在offscreen平台上运行
+//运行：tst_verticaltext [函数名[:数据行]]
+class tst_VerticalText : public QObject
+{
+    Q_OBJECT
+private slots:
+    void mpscQueueOrder();
+    void mpscQueueProducers();
+    void postAppendProducers();
+    void pasteOverSelection();
+    void pasteUndoRedo();
+    void typingUndoRedo();
+    void columnSpacingUndo();
+    void latencyIgnoresUnhandledKeys();
+    void htmlPixelFontSize();
+    void evictionKeepsUndo();
+    void documentMaxColumnLength();
+    void documentColumnAtOffset();
+    void insertTextUndo();
+    void insertRunsUndo();
+    void insertUnknownFormat();
+    void importReadError();
+    void importDeletedBeforeRun();
+    void documentChunkEdits();
+    void searchIndexIn_data();
+    void searchIndexIn();
+    void searchFindWraps();
+    void surrogateCaret();
+    void mappedFileVirtualized();
+};
+
+//第一次读取返回几个字节，之后读取失败
+class CFailingDevice : public QIODevice
+{
+public:
+    CFailingDevice() { open(QIODevice::ReadOnly); }
+    bool isSequential() const override { return true; }
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        if (m_served) {
+            setErrorString(QStringLiteral("read failed"));
+            return -1;
+        }
+        m_served = true;
+        const qint64 n = qMin<qint64>(maxSize, 3);
+        memcpy(data, "abc", size_t(n));
+        return n;
+    }
+    qint64 writeData(const char*, qint64) override { return -1; }
+private:
+    bool m_served = false;
+};
+
+//纯文本文档，换行分列，全部使用缺省格式
+static VerticalTextDocument plainDocument(const QString& text)
+{
+    VerticalTextDocument doc;
+    doc.append(QStringView(text), CFormatRegistry::intern(SCharFormat()));
+    return doc;
+}
+
+static STextRange makeRange(int startCol, int startPos, int endCol, int endPos)
+{
+    STextRange r;
+    r.startCol = startCol;
+    r.startPos = startPos;
+    r.endCol = endCol;
+    r.endPos = endPos;
+    return r;
+}
+
+void tst_VerticalText::mpscQueueOrder()
+{
+    CMpscQueue<int> q;
+    int v = -1;
+    QVERIFY(!q.tryPop(&v));
+    for (int i = 0; i < 100; ++i) {
+        q.push(i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        QVERIFY(q.tryPop(&v));
+        QCOMPARE(v, i);
+    }
+    QVERIFY(!q.tryPop(&v));
+}
+
+//多个生产者同时入队：不丢不重，同一生产者的值保持顺序
+void tst_VerticalText::mpscQueueProducers()
+{
+    const int producers = 4;
+    const int perProducer = 50000;
+    CMpscQueue<int> q;
+    QVector<QThread*> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads << QThread::create([&q, p, perProducer]() {
+            for (int i = 0; i < perProducer; ++i) {
+                q.push(p * perProducer + i);
+            }
+        });
+    }
+    for (QThread* t : threads) {
+        t->start();
+    }
+    //消费者与生产者同时运行
+    QVector<int> next(producers, 0);
+    int received = 0;
+    int v = -1;
+    while (received < producers * perProducer) {
+        if (!q.tryPop(&v)) {
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        const int p = v / perProducer;
+        QVERIFY(p >= 0 && p < producers);
+        QCOMPARE(v % perProducer, next.at(p));
+        ++next[p];
+        ++received;
+    }
+    for (QThread* t : threads) {
+        QVERIFY(t->wait(10000));
+        delete t;
+    }
+    QVERIFY(!q.tryPop(&v));
+    for (int p = 0; p < producers; ++p) {
+        QCOMPARE(next.at(p), perProducer);
+    }
+}
+
+//多线程postAppend：GUI线程处理期间入队的文字最终都会显示，不会留在队列里
+void tst_VerticalText::postAppendProducers()
+{
+    SEditFixture f;
+    const int initial = f.edit->text().length();
+    const int producers = 4;
+    const int perProducer = 2000;
+    QVector<QThread*> threads;
+    for (int p = 0; p < producers; ++p) {
+        CGraphicsEdit* edit = f.edit;
+        threads << QThread::create([edit, perProducer]() {
+            for (int i = 0; i < perProducer; ++i) {
+                edit->postAppend(QStringLiteral("x"));
+                if (i % 64 == 0)
+                    QThread::usleep(100);
+            }
+        });
+    }
+    for (QThread* t : threads) {
+        t->start();
+    }
+    for (QThread* t : threads) {
+        while (!t->wait(1)) {
+            QCoreApplication::processEvents();
+        }
+        delete t;
+    }
+    QTRY_COMPARE(f.edit->text().length(), initial + producers * perProducer);
+}
+
+//粘贴替换选中文字是一个撤销步骤
+void tst_VerticalText::pasteOverSelection()
+{
+    SEditFixture f;
+    f.edit->updateData(plainDocument(QStringLiteral("abcdef\nghij")), 0, 0);
+    f.edit->selectRange(makeRange(0, 2, 1, 1));
+    QGuiApplication::clipboard()->setText(QStringLiteral("XY\nZ"));
+    f.shortcut(QKeySequence::Paste);
+    QCOMPARE(f.edit->text(), QStringLiteral("abXY\nZhij"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("abcdef\nghij"));
+}
+
+//粘贴的撤销只删除粘贴的文字，重做时重新插入；setText后不能撤销到原来的文档
+void tst_VerticalText::pasteUndoRedo()
+{
+    SEditFixture f;
+    f.edit->updateData(plainDocument(QStringLiteral("abcdef")), 2, 0);
+    QGuiApplication::clipboard()->setText(QStringLiteral("XY"));
+    f.shortcut(QKeySequence::Paste);
+    QCOMPARE(f.edit->text(), QStringLiteral("abXYcdef"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("abcdef"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("abXYcdef"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("abcdef"));
+
+    f.shortcut(QKeySequence::Paste);
+    f.edit->setText(QStringLiteral("xyz"));
+    const QString text = f.edit->text();
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), text);
+}
+
+//快照命令重做时恢复撤销前的文字
+void tst_VerticalText::typingUndoRedo()
+{
+    SEditFixture f;
+    f.key(Qt::Key_A, QStringLiteral("a"));
+    f.key(Qt::Key_B, QStringLiteral("b"));
+    f.key(Qt::Key_Backspace);
+    f.key(Qt::Key_C, QStringLiteral("c"));
+    QCOMPARE(f.edit->text(), QStringLiteral("ac"));
+    f.shortcut(QKeySequence::Undo);
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("ab"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("a"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("ac"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("ac"));
+    f.key(Qt::Key_D, QStringLiteral("d"));
+    QCOMPARE(f.edit->text(), QStringLiteral("acd"));
+}
+
+//连续修改列间距只记录一个撤销步骤，撤销和重做恢复列间距
+void tst_VerticalText::columnSpacingUndo()
+{
+    SEditFixture f(plainDocument(QStringLiteral("ab\ncd")));
+    auto spacing = [&]() {
+        qreal s = -1;
+        VerticalTextDocument::fromHtml(f.edit->toHtml(), &s);
+        return s;
+    };
+    const qreal initial = spacing();
+    f.edit->beginFormatChange();
+    f.edit->setColumnSpacing(10);
+    f.edit->setColumnSpacing(20);
+    f.edit->endFormatChange();
+    QCOMPARE(spacing(), qreal(20));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(spacing(), initial);
+    QCOMPARE(f.edit->text(), QStringLiteral("ab\ncd"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(spacing(), qreal(20));
+}
+
+//被忽略的按键（修饰键、不可打印的键）不计入延迟
+void tst_VerticalText::latencyIgnoresUnhandledKeys()
+{
+    SEditFixture f(plainDocument(QStringLiteral("abc")));
+    QImage image(256, 256, QImage::Format_ARGB32_Premultiplied);
+    auto render = [&]() {
+        QPainter painter(&image);
+        f.scene.render(&painter);
+    };
+    f.key(Qt::Key_Shift, QString(), Qt::ShiftModifier);
+    f.key(Qt::Key_Control, QString(), Qt::ControlModifier);
+    f.key(Qt::Key_F5);
+    render();
+    QCOMPARE(f.edit->perfStats().samples, quint32(0));
+    f.key(Qt::Key_A, QStringLiteral("a"));
+    render();
+    QCOMPARE(f.edit->perfStats().samples, quint32(1));
+}
+
+//px字号换算为点数，不会变成-1
+void tst_VerticalText::htmlPixelFontSize()
+{
+    const VerticalTextDocument doc = VerticalTextDocument::fromHtml(
+                QStringLiteral("<span style=\"font-size:16px\">a</span><span style=\"font-size:18pt\">b</span>"));
+    QCOMPARE(doc.text(0), QStringLiteral("ab"));
+    QCOMPARE(CFormatRegistry::format(doc.formatAt(0, 0)).fontSize, 12);
+    QCOMPARE(CFormatRegistry::format(doc.formatAt(0, 1)).fontSize, 18);
+}
+
+//移出开头的列后撤销栈不改写：撤销到的快照去掉之后移出的列，快照的列全部移出时不能撤销
+void tst_VerticalText::evictionKeepsUndo()
+{
+    SEditFixture f;
+    f.edit->updateData(plainDocument(QStringLiteral("a\nb\nc")), 0, 0);
+    f.edit->insertText(f.edit->text().length(), u"x");
+    f.edit->setMaximumColumnCount(2);
+    QCOMPARE(f.edit->text(), QStringLiteral("b\ncx"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("b\nc"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("b\ncx"));
+    f.shortcut(QKeySequence::Undo);
+
+    //修改的列被移出
+    f.edit->insertText(0, u"y");
+    f.edit->appendText(u"\nd");
+    QCOMPARE(f.edit->text(), QStringLiteral("c\nd"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("c"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("c\nd"));
+
+    f.edit->insertText(0, u"z");
+    f.edit->appendText(u"\ne\nf");
+    QCOMPARE(f.edit->text(), QStringLiteral("e\nf"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("e\nf"));
+
+    //粘贴的范围按移出的列数换算
+    f.edit->setCursorPosition(f.edit->text().length());
+    QGuiApplication::clipboard()->setText(QStringLiteral("P"));
+    f.shortcut(QKeySequence::Paste);
+    f.edit->appendText(u"\ng");
+    QCOMPARE(f.edit->text(), QStringLiteral("fP\ng"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), QStringLiteral("f\ng"));
+    f.shortcut(QKeySequence::Redo);
+    QCOMPARE(f.edit->text(), QStringLiteral("fP\ng"));
+}
+
+//按块统计的最长列：变长、变短、移出和跨块替换后都与逐列统计一致
+void tst_VerticalText::documentMaxColumnLength()
+{
+    VerticalTextDocument doc;
+    for (int i = 0; i < 3 * VerticalTextDocument::ChunkColumns; ++i) {
+        doc.append(QStringView(QString(i % 7 + 1, QChar('a'))), 0);
+        doc.append(QStringView(u"\n"), 0);
+    }
+    auto scan = [](const VerticalTextDocument& d) {
+        int length = 0;
+        for (int i = 0; i < d.columnCount(); ++i) {
+            length = qMax(length, d.columnLength(i));
+        }
+        return length;
+    };
+    QCOMPARE(doc.maxColumnLength(), 7);
+    doc.setColumn(300, QString(40, QChar('b')), QVector<int>(40, 0));
+    QCOMPARE(doc.maxColumnLength(), 40);
+    doc.setColumn(300, QStringLiteral("b"), QVector<int>(1, 0));
+    QCOMPARE(doc.maxColumnLength(), scan(doc));
+
+    const VerticalTextDocument snapshot = doc;
+    doc.setColumn(10, QString(50, QChar('c')), QVector<int>(50, 0));
+    doc.remove(makeRange(250, 1, 260, 0));
+    QCOMPARE(doc.maxColumnLength(), 50);
+    QCOMPARE(snapshot.maxColumnLength(), 7);
+    doc.removeFirstColumns(20);
+    QCOMPARE(doc.maxColumnLength(), scan(doc));
+}
+
+//按块二分查找的结果与逐列计算一致，包括块边界、列尾和移出开头的列之后
+void tst_VerticalText::documentColumnAtOffset()
+{
+    VerticalTextDocument doc;
+    for (int i = 0; i < 3 * VerticalTextDocument::ChunkColumns; ++i) {
+        doc.append(QStringView(QString(i % 5, QChar('a'))), 0);
+        doc.append(QStringView(u"\n"), 0);
+    }
+    auto check = [](const VerticalTextDocument& d) {
+        const QString text = d.toPlainText();
+        for (int offset = 0; offset <= text.length() + 2; ++offset) {
+            int c = 0;
+            int rest = offset;
+            while (c < d.columnCount() - 1 && rest > d.columnLength(c)) {
+                rest -= d.columnLength(c) + 1;
+                ++c;
+            }
+            int col = -1;
+            int pos = -1;
+            d.columnAtOffset(offset, &col, &pos);
+            if (col != c || pos != qMin(rest, d.columnLength(c)))
+                return false;
+        }
+        return true;
+    };
+    QVERIFY(check(doc));
+    doc.setColumn(100, QStringLiteral("longer column"), QVector<int>(13, 0));
+    QVERIFY(check(doc));
+    doc.remove(makeRange(250, 1, 260, 0));
+    QVERIFY(check(doc));
+    doc.removeFirstColumns(300);
+    QVERIFY(check(doc));
+}
+
+static int boldFormat()
+{
+    SCharFormat sf;
+    sf.bold = true;
+    return CFormatRegistry::intern(sf);
+}
+
+//批量插入：偏移换算到正确的列，换行拆列，格式按片段设置，整体一个撤销步骤
+void tst_VerticalText::insertTextUndo()
+{
+    SEditFixture f;
+    const QString original = QStringLiteral("abc\ndef");
+    f.edit->updateData(plainDocument(original), 0, 0);
+    const int bold = boldFormat();
+    f.edit->insertText(5, u"X\nY", bold);
+    QCOMPARE(f.edit->text(), QStringLiteral("abc\ndX\nYef"));
+    const VerticalTextDocument& doc = f.edit->document();
+    QCOMPARE(doc.columnCount(), 3);
+    QCOMPARE(doc.formatAt(1, 0), doc.formatAt(0, 0));
+    QCOMPARE(doc.formatAt(1, 1), bold);
+    QCOMPARE(doc.formatAt(2, 0), bold);
+    QCOMPARE(doc.formatAt(2, 1), doc.formatAt(0, 0));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), original);
+}
+
+void tst_VerticalText::insertRunsUndo()
+{
+    SEditFixture f;
+    const QString original = QStringLiteral("abc\ndef");
+    f.edit->updateData(plainDocument(original), 0, 0);
+    const int plain = f.edit->document().formatAt(0, 0);
+    const int bold = boldFormat();
+    f.edit->insertRuns(original.length(), {STextRun{QStringLiteral("R1"), bold}, STextRun{QStringLiteral("\nR2"), plain}});
+    QCOMPARE(f.edit->text(), QStringLiteral("abc\ndefR1\nR2"));
+    const VerticalTextDocument& doc = f.edit->document();
+    QCOMPARE(doc.columnCount(), 3);
+    QCOMPARE(doc.formatAt(1, 2), plain);
+    QCOMPARE(doc.formatAt(1, 3), bold);
+    QCOMPARE(doc.formatAt(1, 4), bold);
+    QCOMPARE(doc.formatAt(2, 0), plain);
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), original);
+}
+
+//未登记的格式ID换成当前输入格式，不会静默变成默认格式保存下来
+void tst_VerticalText::insertUnknownFormat()
+{
+    SEditFixture f;
+    const int bold = boldFormat();
+    f.edit->setBold(true);
+    const int unknown = CFormatRegistry::count() + 100;
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("unknown format id")));
+    f.edit->insertText(0, u"ab", unknown);
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("unknown format id")));
+    f.edit->insertRuns(-1, {STextRun{QStringLiteral("c"), unknown}});
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("unknown format id")));
+    f.edit->appendText(u"d", unknown);
+    QCOMPARE(f.edit->text(), QStringLiteral("abcd"));
+    for (int i = 0; i < 4; ++i) {
+        QCOMPARE(f.edit->document().formatAt(0, i), bold);
+    }
+}
+
+//读取失败时报告错误，不当作导入完成
+void tst_VerticalText::importReadError()
+{
+    CTextImporter importer;
+    QSignalSpy spy(&importer, &CTextImporter::finished);
+    importer.start(new CFailingDevice);
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(spy.at(0).at(0).toBool(), false);
+    QCOMPARE(spy.at(0).at(1).toString(), QStringLiteral("read failed"));
+}
+
+//导入还没开始就被删除（如再次调用importPlainText）：设备也被删除
+void tst_VerticalText::importDeletedBeforeRun()
+{
+    CTextImporter* importer = new CTextImporter;
+    QPointer<QIODevice> device = new CFailingDevice;
+    importer->start(device);
+    delete importer;
+    QVERIFY(device.isNull());
+}
+
+//text中第col列pos处的偏移
+static int offsetOf(const QString& text, int col, int pos)
+{
+    int offset = 0;
+    for (int i = 0; i < col; ++i) {
+        offset = text.indexOf(QChar('\n'), offset) + 1;
+    }
+    return offset + pos;
+}
+
+//各字符格式为plain时记为A，否则为B，列间为换行
+static QString formatString(const VerticalTextDocument& doc, int plain)
+{
+    QString s;
+    for (int i = 0; i < doc.columnCount(); ++i) {
+        if (i > 0)
+            s += QChar('\n');
+        for (int j = 0; j < doc.columnLength(i); ++j) {
+            s += (doc.formatAt(i, j) == plain ? QChar('A') : QChar('B'));
+        }
+    }
+    return s;
+}
+
+//跨越256列块边界的插入、删除和移出：文字、格式与逐字符的参照结果一致，快照不受影响
+void tst_VerticalText::documentChunkEdits()
+{
+    const int plain = CFormatRegistry::intern(SCharFormat());
+    const int bold = boldFormat();
+    VerticalTextDocument doc;
+    QString text;
+    QString fmt;
+    for (int i = 0; i < 600; ++i) {
+        const QString line = QString::number(i);
+        doc.append(QStringView(line), plain);
+        text += line;
+        fmt += QString(line.length(), QChar('A'));
+        if (i < 599) {
+            doc.append(QStringView(u"\n"), plain);
+            text += QChar('\n');
+            fmt += QChar('\n');
+        }
+    }
+    const VerticalTextDocument snapshot = doc;
+    const QString original = text;
+    auto verify = [&]() {
+        if (doc.toPlainText() != text || formatString(doc, plain) != fmt)
+            return false;
+        if (doc.columnCount() != text.count(QChar('\n')) + 1)
+            return false;
+        for (int i = 0; i < doc.columnCount(); ++i) {
+            if (doc.formats(i).size() != doc.columnLength(i))
+                return false;
+        }
+        return true;
+    };
+    QVERIFY(verify());
+
+    //插入多列，拆开第一块的最后一列
+    VerticalTextDocument small;
+    small.append(u"x\ny\nz", bold);
+    doc.insert(255, 1, small);
+    int offset = offsetOf(text, 255, 1);
+    text.insert(offset, QStringLiteral("x\ny\nz"));
+    fmt.insert(offset, QStringLiteral("B\nB\nB"));
+    QVERIFY(verify());
+
+    //删除范围跨越三块
+    const int begin = offsetOf(text, 250, 1);
+    const int end = offsetOf(text, 520, 0);
+    doc.remove(makeRange(250, 1, 520, 0));
+    text.remove(begin, end - begin);
+    fmt.remove(begin, end - begin);
+    QVERIFY(verify());
+
+    //插入的列超过两块，重新分块
+    VerticalTextDocument large;
+    QString largeText;
+    for (int i = 0; i < 3 * VerticalTextDocument::ChunkColumns; ++i) {
+        largeText += (i == 0 ? QString() : QStringLiteral("\n")) + QStringLiteral("L");
+    }
+    large.append(QStringView(largeText), bold);
+    doc.insert(10, 0, large);
+    offset = offsetOf(text, 10, 0);
+    text.insert(offset, largeText);
+    fmt.insert(offset, QString(largeText).replace(QChar('L'), QChar('B')));
+    QVERIFY(verify());
+
+    //移出开头的列后继续追加和修改
+    doc.removeFirstColumns(300);
+    offset = offsetOf(text, 300, 0);
+    text.remove(0, offset);
+    fmt.remove(0, offset);
+    QVERIFY(verify());
+    doc.append(u"\ntail", plain);
+    text += QStringLiteral("\ntail");
+    fmt += QStringLiteral("\nAAAA");
+    doc.setColumn(0, QStringLiteral("head"), QVector<int>(4, bold));
+    const int firstEnd = text.indexOf(QChar('\n'));
+    text.replace(0, firstEnd, QStringLiteral("head"));
+    fmt.replace(0, firstEnd, QStringLiteral("BBBB"));
+    QVERIFY(verify());
+
+    QCOMPARE(snapshot.toPlainText(), original);
+    QCOMPARE(snapshot.columnCount(), 600);
+}
+
+void tst_VerticalText::searchIndexIn_data()
+{
+    QTest::addColumn<Qt::CaseSensitivity>("cs");
+    QTest::newRow("sensitive") << Qt::CaseSensitive;
+    QTest::newRow("insensitive") << Qt::CaseInsensitive;
+}
+
+//与QString::indexOf逐一比较：长度0~40覆盖8单元一组的向量部分和剩余的尾部，
+//匹配放在每个位置（包括最后一个起点）；字母表含开尔文符号、长s和非ASCII字符，覆盖不筛选的路径
+void tst_VerticalText::searchIndexIn()
+{
+    QFETCH(Qt::CaseSensitivity, cs);
+    static const int lengths[] = {1, 2, 3, 8, 9, 12};
+    const QStringList patterns = {QStringLiteral("a"), QStringLiteral("Ab"), QStringLiteral("aBcDeFgHiJ"),
+                                  QStringLiteral("k"), QStringLiteral("Ks"), QStringLiteral("étÉ"),
+                                  QStringLiteral("中文"), QStringLiteral("x\U0001F600")};
+    for (int len = 0; len <= 40; ++len) {
+        for (const QString& pattern : patterns) {
+            const CTextSearch search(pattern, cs);
+            for (int pos = 0; pos + pattern.size() <= len; ++pos) {
+                QString s(len, QChar('x'));
+                s.replace(pos, pattern.size(), cs == Qt::CaseSensitive ? pattern : pattern.toUpper());
+                for (int from : {0, pos, pos + 1, len - int(pattern.size())}) {
+                    QCOMPARE(search.indexIn(QStringView(s), from), s.indexOf(pattern, from, cs));
+                }
+            }
+        }
+    }
+
+    const QString alphabet = QStringLiteral("aAbBkKsSKſéÉ中文");
+    QRandomGenerator rng(46);
+    for (int len = 0; len <= 40; ++len) {
+        for (int trial = 0; trial < 10; ++trial) {
+            QString s;
+            for (int i = 0; i < len; ++i) {
+                s += alphabet.at(int(rng.bounded(alphabet.size())));
+            }
+            for (int m : lengths) {
+                for (int start = 0; start + m <= len; ++start) {
+                    QString pattern = s.mid(start, m);
+                    if (rng.bounded(2))
+                        pattern = pattern.toUpper();
+                    const CTextSearch search(pattern, cs);
+                    for (int from : {0, start, len - m, len - m + 1}) {
+                        QCOMPARE(search.indexIn(QStringView(s), from), s.indexOf(pattern, from, cs));
+                    }
+                }
+            }
+        }
+    }
+}
+
+static bool sameRange(const STextRange& a, const STextRange& b)
+{
+    return a.startCol == b.startCol && a.startPos == b.startPos && a.endCol == b.endCol && a.endPos == b.endPos;
+}
+
+//查找上一个、下一个到达文档一端后从另一端继续
+void tst_VerticalText::searchFindWraps()
+{
+    const VerticalTextDocument doc = plainDocument(QStringLiteral("ab\nxab\nc\nAB"));
+    const CTextSearch sensitive(QStringLiteral("ab"));
+    const CTextSearch insensitive(QStringLiteral("ab"), Qt::CaseInsensitive);
+
+    QVERIFY(sameRange(sensitive.findPrevious(doc, 0, 2), makeRange(0, 0, 0, 2)));
+    QVERIFY(sameRange(sensitive.findPrevious(doc, 0, 1), makeRange(1, 1, 1, 3)));
+    QVERIFY(sameRange(sensitive.findPrevious(doc, 0, 0), makeRange(1, 1, 1, 3)));
+    QVERIFY(sameRange(insensitive.findPrevious(doc, 0, 0), makeRange(3, 0, 3, 2)));
+    QVERIFY(sameRange(sensitive.findPrevious(doc, 1, 2), makeRange(0, 0, 0, 2)));
+
+    QVERIFY(sameRange(sensitive.findNext(doc, 1, 2), makeRange(0, 0, 0, 2)));
+    QVERIFY(sameRange(insensitive.findNext(doc, 1, 2), makeRange(3, 0, 3, 2)));
+
+    //只有一个匹配时回到起点列前面的部分
+    const VerticalTextDocument single = plainDocument(QStringLiteral("xab"));
+    QVERIFY(sameRange(sensitive.findPrevious(single, 0, 1), makeRange(0, 1, 0, 3)));
+    QVERIFY(sameRange(sensitive.findNext(single, 0, 2), makeRange(0, 1, 0, 3)));
+    QVERIFY(sensitive.findPrevious(plainDocument(QStringLiteral("x\ny")), 1, 1).isEmpty());
+}
+
+//文字中没有拆开的代理对
+static bool hasLoneSurrogate(const QString& s)
+{
+    for (int i = 0; i < s.size(); ++i) {
+        if (s.at(i).isHighSurrogate() && i + 1 < s.size() && s.at(i + 1).isLowSurrogate())
+            ++i;
+        else if (s.at(i).isSurrogate())
+            return true;
+    }
+    return false;
+}
+
+//光标按字形簇移动和删除，不会停在代理对或组合字符中间
+void tst_VerticalText::surrogateCaret()
+{
+    const QString text = QStringLiteral("a\U0001F600be\u0301");
+    const VerticalTextDocument doc = plainDocument(text);
+    CBoundaryIndex boundaries;
+    boundaries.setDocument(&doc);
+    QCOMPARE(boundaries.nextGrapheme(0, 1), 3);
+    QCOMPARE(boundaries.previousGrapheme(0, 3), 1);
+    QCOMPARE(boundaries.alignToGrapheme(0, 2), 1);
+    QCOMPARE(boundaries.nextGrapheme(0, 4), 6);
+    QCOMPARE(boundaries.previousGrapheme(0, 6), 4);
+    QCOMPARE(boundaries.alignToGrapheme(0, 5), 4);
+
+    SEditFixture f;
+    f.edit->updateData(doc, 3, 0);
+    f.key(Qt::Key_Backspace);
+    QCOMPARE(f.edit->text(), QStringLiteral("abe\u0301"));
+    f.shortcut(QKeySequence::Undo);
+    QCOMPARE(f.edit->text(), text);
+
+    f.edit->setCursorPosition(1);
+    f.key(Qt::Key_Delete);
+    QCOMPARE(f.edit->text(), QStringLiteral("abe\u0301"));
+    f.shortcut(QKeySequence::Undo);
+
+    //竖排时下、上方向键在列内前后移动
+    f.edit->setCursorPosition(0);
+    f.key(Qt::Key_Down);
+    f.key(Qt::Key_Down);
+    f.key(Qt::Key_X, QStringLiteral("x"));
+    QCOMPARE(f.edit->text(), QStringLiteral("a\U0001F600xbe\u0301"));
+    f.key(Qt::Key_Down);
+    f.key(Qt::Key_Down);
+    f.key(Qt::Key_Up);
+    f.key(Qt::Key_Y, QStringLiteral("y"));
+    QCOMPARE(f.edit->text(), QStringLiteral("a\U0001F600xbye\u0301"));
+    f.edit->setCursorPosition(int(f.edit->text().size()));
+    for (int i = 0; i < 4; ++i) {
+        f.key(Qt::Key_Up);
+    }
+    f.key(Qt::Key_Backspace);
+    QCOMPARE(f.edit->text(), QStringLiteral("axbye\u0301"));
+    QVERIFY(!hasLoneSurrogate(f.edit->text()));
+}
+
+//映射文件总是虚拟显示，换成可编辑的文档后恢复打开前的状态，并通知界面
+void tst_VerticalText::mappedFileVirtualized()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    file.write("first\nsecond\nthird\n");
+    file.flush();
+
+    SEditFixture f;
+    QSignalSpy spy(f.edit, &CGraphicsEdit::virtualizedChanged);
+    QVERIFY(!f.edit->isVirtualized());
+    QVERIFY(f.edit->openMappedFile(file.fileName()));
+    QVERIFY(f.edit->isVirtualized());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.last().at(0).toBool(), true);
+    //只读时不能关闭
+    f.edit->setVirtualized(false);
+    QVERIFY(f.edit->isVirtualized());
+    QCOMPARE(spy.last().at(0).toBool(), true);
+
+    f.edit->setText(QStringLiteral("abc"));
+    QVERIFY(!f.edit->isReadOnly());
+    QVERIFY(!f.edit->isVirtualized());
+    QCOMPARE(spy.last().at(0).toBool(), false);
+
+    f.edit->setVirtualized(true);
+    QVERIFY(f.edit->openMappedFile(file.fileName()));
+    f.edit->updateData(plainDocument(QStringLiteral("abc")), 0, 0);
+    QVERIFY(f.edit->isVirtualized());
+}
+
+int main(int argc, char *argv[])
+{
+    //默认不需要显示环境
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    tst_VerticalText tc;
+    return QTest::qExec(&tc, argc, argv);
+}
+
+#include "tst_verticaltext.moc"
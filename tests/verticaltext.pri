@@ -0,0 +1,40 @@
+# Sources shared by the test and benchmark targets, plus the edit fixture.
+
+INCLUDEPATH += $$PWD/.. $$PWD
+
+SOURCES += \
+    $$PWD/../cboundaryindex.cpp \
+    $$PWD/../cglyphcache.cpp \
+    $$PWD/../cgraphicsedit.cpp \
+    $$PWD/../clatencyhistogram.cpp \
+    $$PWD/../cmappedtextfile.cpp \
+    $$PWD/../cscenesearch.cpp \
+    $$PWD/../cselectionmimedata.cpp \
+    $$PWD/../cshapecache.cpp \
+    $$PWD/../ctextimporter.cpp \
+    $$PWD/../ctextsearch.cpp \
+    $$PWD/../ctilerenderer.cpp \
+    $$PWD/../ctrace.cpp \
+    $$PWD/../scharformat.cpp \
+    $$PWD/../verticaltextdocument.cpp \
+    $$PWD/../verticaltextlayout.cpp
+
+HEADERS += \
+    $$PWD/editfixture.h \
+    $$PWD/../cboundaryindex.h \
+    $$PWD/../cglyphcache.h \
+    $$PWD/../cgraphicsedit.h \
+    $$PWD/../clatencyhistogram.h \
+    $$PWD/../cmappedtextfile.h \
+    $$PWD/../cmpscqueue.h \
+    $$PWD/../cscenesearch.h \
+    $$PWD/../cselectionmimedata.h \
+    $$PWD/../cshapecache.h \
+    $$PWD/../ctextimporter.h \
+    $$PWD/../ctextsearch.h \
+    $$PWD/../ctilerenderer.h \
+    $$PWD/../ctrace.h \
+    $$PWD/../cverticalorientation.h \
+    $$PWD/../scharformat.h \
+    $$PWD/../verticaltextdocument.h \
+    $$PWD/../verticaltextlayout.h
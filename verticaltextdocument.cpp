@@ -0,0 +1,512 @@
+#include "verticaltextdocument.h"
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <algorithm>
+#include "ctrace.h"
+
+static const quint32 NATIVE_MAGIC = 0x56544431;   //"VTD1"
+static const quint16 NATIVE_VERSION = 1;
+
+static int defaultFormatId()
+{
+    static const int id = CFormatRegistry::intern(SCharFormat());
+    return id;
+}
+
+VerticalTextDocument::VerticalTextDocument()
+{
+    clear();
+}
+
+int VerticalTextDocument::formatAt(int col, int pos) const
+{
+    if (m_mapped)
+        return defaultFormatId();
+    int k;
+    const QVector<int>& f = chunkAt(col, &k).formats.at(k);
+    if (pos < 0 || pos >= f.size())
+        return defaultFormatId();
+    return f.at(pos);
+}
+
+void VerticalTextDocument::SChunk::updateStats()
+{
+    maxLength = 0;
+    chars = 0;
+    for (const QString& s : texts) {
+        maxLength = qMax(maxLength, s.length());
+        chars += s.length();
+    }
+}
+
+int VerticalTextDocument::chunkIndex(int col) const
+{
+    //最后一个起点不大于该列的块
+    const qint64 abs = m_base + col;
+    const int k = int(std::upper_bound(m_chunkStarts.constBegin(), m_chunkStarts.constEnd(), abs) - m_chunkStarts.constBegin()) - 1;
+    return qBound(0, k, m_chunks.size() - 1);
+}
+
+const VerticalTextDocument::SChunk& VerticalTextDocument::chunkAt(int col, int* offset) const
+{
+    const int k = chunkIndex(col);
+    *offset = int(m_base + col - m_chunkStarts.at(k));
+    return *m_chunks.at(k);
+}
+
+VerticalTextDocument::SChunk& VerticalTextDocument::mutableChunkAt(int col, int* offset)
+{
+    const int k = chunkIndex(col);
+    *offset = int(m_base + col - m_chunkStarts.at(k));
+    return *m_chunks[k];
+}
+
+void VerticalTextDocument::updateChunkStarts(int from)
+{
+    for (int k = qMax(from, 0); k < m_chunks.size(); ++k) {
+        if (k == 0) {
+            m_chunkStarts[k] = m_base;
+            m_chunkOffsets[k] = m_offsetBase;
+            continue;
+        }
+        const SChunk& prev = *m_chunks.at(k - 1);
+        m_chunkStarts[k] = m_chunkStarts.at(k - 1) + prev.texts.size();
+        m_chunkOffsets[k] = m_chunkOffsets.at(k - 1) + prev.chars + prev.texts.size();
+    }
+}
+
+void VerticalTextDocument::replaceColumns(int first, int removed, const QStringList& texts, const QList<QVector<int>>& formats)
+{
+    //首尾两块中范围外的列和新列合在一起，重新分块
+    const int kFirst = (first < m_columnCount ? chunkIndex(first) : m_chunks.size() - 1);
+    const int kLast = (removed > 0 ? chunkIndex(first + removed - 1) : kFirst);
+    const SChunk& a = *m_chunks.at(kFirst);
+    const SChunk& b = *m_chunks.at(kLast);
+    const int head = int(m_base + first - m_chunkStarts.at(kFirst));
+    const int tail = int(m_base + first + removed - m_chunkStarts.at(kLast));
+    QStringList t = a.texts.mid(0, head);
+    QList<QVector<int>> f = a.formats.mid(0, head);
+    t += texts;
+    f += formats;
+    t += b.texts.mid(tail);
+    f += b.formats.mid(tail);
+
+    QList<ChunkPointer> pieces;
+    const int step = (t.size() > 2 * ChunkColumns ? ChunkColumns : qMax(t.size(), 1));
+    for (int i = 0; i < t.size(); i += step) {
+        SChunk* c = new SChunk;
+        c->texts = t.mid(i, step);
+        c->formats = f.mid(i, step);
+        c->updateStats();
+        pieces << ChunkPointer(c);
+    }
+    m_chunks.erase(m_chunks.begin() + kFirst, m_chunks.begin() + kLast + 1);
+    m_chunkStarts.erase(m_chunkStarts.begin() + kFirst, m_chunkStarts.begin() + kLast + 1);
+    m_chunkOffsets.erase(m_chunkOffsets.begin() + kFirst, m_chunkOffsets.begin() + kLast + 1);
+    for (int i = 0; i < pieces.size(); ++i) {
+        m_chunks.insert(kFirst + i, pieces.at(i));
+        m_chunkStarts.insert(kFirst + i, 0);
+        m_chunkOffsets.insert(kFirst + i, 0);
+    }
+    m_columnCount += texts.size() - removed;
+    updateChunkStarts(kFirst);
+}
+
+void VerticalTextDocument::appendColumn(const QString& text, const QVector<int>& formats)
+{
+    if (m_chunks.constLast()->texts.size() >= ChunkColumns) {
+        const SChunk& last = *m_chunks.constLast();
+        m_chunkStarts << m_chunkStarts.constLast() + last.texts.size();
+        m_chunkOffsets << m_chunkOffsets.constLast() + last.chars + last.texts.size();
+        m_chunks << ChunkPointer(new SChunk);
+    }
+    SChunk* c = m_chunks.last().data();
+    c->texts << text;
+    c->formats << formats;
+    c->maxLength = qMax(c->maxLength, text.length());
+    c->chars += text.length();
+    ++m_columnCount;
+}
+
+int VerticalTextDocument::maxColumnLength() const
+{
+    if (m_mapped)
+        return m_mapped->maxLineLength();
+    int length = 0;
+    for (const ChunkPointer& c : m_chunks) {
+        length = qMax(length, c->maxLength);
+    }
+    return length;
+}
+
+VerticalTextDocument VerticalTextDocument::fromMappedFile(const QSharedPointer<CMappedTextFile>& file)
+{
+    VerticalTextDocument d;
+    d.m_mapped = file;
+    return d;
+}
+
+void VerticalTextDocument::columnAtOffset(qint64 offset, int* col, int* pos) const
+{
+    const int n = columnCount();
+    if (m_mapped) {
+        //映射文件没有按块统计，逐列计算
+        int c = 0;
+        while (c < n - 1 && offset > columnLength(c)) {
+            offset -= columnLength(c) + 1;
+            ++c;
+        }
+        *col = c;
+        *pos = int(qMin<qint64>(offset, columnLength(c)));
+        return;
+    }
+    //最后一个偏移不大于offset的块，再在块内逐列计算
+    const qint64 abs = m_offsetBase + qMax<qint64>(offset, 0);
+    const int k = qMax(0, int(std::upper_bound(m_chunkOffsets.constBegin(), m_chunkOffsets.constEnd(), abs) - m_chunkOffsets.constBegin()) - 1);
+    const SChunk& c = *m_chunks.at(k);
+    qint64 rest = abs - m_chunkOffsets.at(k);
+    int i = 0;
+    while (i < c.texts.size() - 1 && rest > c.texts.at(i).length()) {
+        rest -= c.texts.at(i).length() + 1;
+        ++i;
+    }
+    *col = int(m_chunkStarts.at(k) - m_base) + i;
+    *pos = int(qMin<qint64>(rest, c.texts.at(i).length()));
+}
+
+QString VerticalTextDocument::toPlainText() const
+{
+    return toPlainText(fullRange());
+}
+
+QString VerticalTextDocument::toPlainText(const STextRange& r) const
+{
+    //先算出总长度，一次分配
+    int length = r.endCol - r.startCol;
+    for (int i = r.startCol; i <= r.endCol; ++i) {
+        const int bp = (i == r.startCol ? r.startPos : 0);
+        const int ep = (i == r.endCol ? r.endPos : columnLength(i));
+        length += ep - bp;
+    }
+    QString s;
+    s.reserve(length);
+    for (int i = r.startCol; i <= r.endCol; ++i) {
+        const QString str = text(i);
+        const int bp = (i == r.startCol ? r.startPos : 0);
+        const int ep = (i == r.endCol ? r.endPos : str.length());
+        s.append(str.constData() + bp, ep - bp);
+        if (i != r.endCol)
+            s.append(QChar('\n'));
+    }
+    return s;
+}
+
+STextRange VerticalTextDocument::fullRange() const
+{
+    STextRange r;
+    r.endCol = columnCount() - 1;
+    r.endPos = columnLength(r.endCol);
+    return r;
+}
+
+void VerticalTextDocument::clear()
+{
+    m_mapped.clear();
+    SChunk* c = new SChunk;
+    c->texts << QString("");
+    c->formats << QVector<int>();
+    m_chunks.clear();
+    m_chunks << ChunkPointer(c);
+    m_chunkStarts.clear();
+    m_chunkStarts << 0;
+    m_chunkOffsets.clear();
+    m_chunkOffsets << 0;
+    m_offsetBase = 0;
+    m_base = 0;
+    m_columnCount = 1;
+}
+
+void VerticalTextDocument::setColumn(int col, const QString& text, const QVector<int>& formats)
+{
+    Q_ASSERT(!m_mapped);
+    int k;
+    SChunk& c = mutableChunkAt(col, &k);
+    const int old = c.texts.at(k).length();
+    c.texts[k] = text;
+    c.formats[k] = formats;
+    c.chars += text.length() - old;
+    //之后各块的偏移随之移动
+    if (text.length() != old) {
+        for (int i = chunkIndex(col) + 1; i < m_chunkOffsets.size(); ++i) {
+            m_chunkOffsets[i] += text.length() - old;
+        }
+    }
+    //最长的列变短时才重新统计整块
+    if (text.length() >= c.maxLength)
+        c.maxLength = text.length();
+    else if (old == c.maxLength)
+        c.updateStats();
+}
+
+void VerticalTextDocument::insert(int col, int pos, const VerticalTextDocument& other, int* endCol, int* endPos)
+{
+    Q_ASSERT(!m_mapped);
+    const QString s = text(col);
+    const QVector<int> sf = formats(col);
+    const int count = other.columnCount();
+    if (count == 1) {
+        setColumn(col, s.left(pos) + other.text(0) + s.mid(pos), sf.mid(0, pos) + other.formats(0) + sf.mid(pos));
+        if (endCol) *endCol = col;
+        if (endPos) *endPos = pos + other.columnLength(0);
+        return;
+    }
+
+    //插入位置所在列拆成两段，中间是other的各列
+    QStringList texts;
+    QList<QVector<int>> formats;
+    texts.reserve(count);
+    formats.reserve(count);
+    texts << s.left(pos) + other.text(0);
+    formats << sf.mid(0, pos) + other.formats(0);
+    for (int i = 1; i < count - 1; ++i) {
+        texts << other.text(i);
+        formats << other.formats(i);
+    }
+    texts << other.text(count - 1) + s.mid(pos);
+    formats << other.formats(count - 1) + sf.mid(pos);
+    replaceColumns(col, 1, texts, formats);
+    if (endCol) *endCol = col + count - 1;
+    if (endPos) *endPos = other.columnLength(count - 1);
+}
+
+void VerticalTextDocument::remove(const STextRange& r)
+{
+    Q_ASSERT(!m_mapped);
+    const QString t = text(r.startCol).left(r.startPos) + text(r.endCol).mid(r.endPos);
+    const QVector<int> f = formats(r.startCol).mid(0, r.startPos) + formats(r.endCol).mid(r.endPos);
+    if (r.endCol == r.startCol) {
+        setColumn(r.startCol, t, f);
+        return;
+    }
+    //中间整列一次删除
+    replaceColumns(r.startCol, r.endCol - r.startCol + 1, QStringList() << t, QList<QVector<int>>() << f);
+}
+
+void VerticalTextDocument::removeFirstColumns(int count)
+{
+    Q_ASSERT(!m_mapped);
+    count = qMin(count, m_columnCount - 1);
+    if (count <= 0)
+        return;
+    m_base += count;
+    m_columnCount -= count;
+    while (count > 0) {
+        const int size = m_chunks.constFirst()->texts.size();
+        if (size <= count) {
+            const SChunk& first = *m_chunks.constFirst();
+            m_offsetBase += first.chars + first.texts.size();
+            m_chunks.removeFirst();
+            m_chunkStarts.removeFirst();
+            m_chunkOffsets.removeFirst();
+            count -= size;
+        } else {
+            SChunk* c = m_chunks.first().data();
+            qint64 removed = count;
+            for (int i = 0; i < count; ++i) {
+                removed += c->texts.at(i).length();
+            }
+            m_offsetBase += removed;
+            m_chunkOffsets.first() += removed;
+            c->texts.erase(c->texts.begin(), c->texts.begin() + count);
+            c->formats.erase(c->formats.begin(), c->formats.begin() + count);
+            c->updateStats();
+            m_chunkStarts.first() += count;
+            count = 0;
+        }
+    }
+}
+
+void VerticalTextDocument::append(QStringView text, int formatId)
+{
+    Q_ASSERT(!m_mapped);
+    const int n = text.size();
+    int start = 0;
+    for (int i = 0; i <= n; ++i) {
+        if (i < n && text.at(i) != QChar('\n'))
+            continue;
+        int end = i;
+        if (end > start && text.at(end - 1) == QChar('\r'))
+            --end;
+        if (end > start) {
+            //只复制最后一块
+            SChunk* c = m_chunks.last().data();
+            c->texts.last().append(text.data() + start, end - start);
+            QVector<int>& lf = c->formats.last();
+            lf.insert(lf.size(), end - start, formatId);
+            c->maxLength = qMax(c->maxLength, c->texts.last().length());
+            c->chars += end - start;
+        }
+        if (i < n)
+            appendColumn(QString(), QVector<int>());
+        start = i + 1;
+    }
+}
+
+VerticalTextDocument VerticalTextDocument::fromTextDocument(const QTextDocument* doc)
+{
+    VerticalTextDocument d;
+    for (QTextBlock block = doc->begin(); block.isValid(); block = block.next()) {
+        if (block != doc->begin())
+            d.appendColumn(QString(), QVector<int>());
+        //按格式片段整段转换，不再逐字符定位光标
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment frag = it.fragment();
+            if (!frag.isValid())
+                continue;
+            const QTextCharFormat tf = frag.charFormat();
+            SCharFormat sf;
+            sf.fromFont(tf.font());
+            if (sf.fontSize <= 0)
+                sf.fontSize = SCharFormat().fontSize;
+            sf.fontColor = tf.foreground().color();
+            QString text = frag.text();
+            text.replace(QChar::Nbsp, QChar(' '));
+            text.replace(QChar::LineSeparator, QChar('\n'));
+            d.append(QStringView(text), CFormatRegistry::intern(sf));
+        }
+    }
+    return d;
+}
+
+VerticalTextDocument VerticalTextDocument::fromHtml(const QString& html, qreal* columnSpacing)
+{
+    TRACE_SCOPE(lcTraceImport, "VerticalTextDocument::fromHtml");
+    QTextDocument doc;
+    doc.setHtml(html);
+    if (columnSpacing) {
+        //toHtml把列间距写在最后一段
+        *columnSpacing = doc.lastBlock().blockFormat().lineHeight();
+    }
+    return fromTextDocument(&doc);
+}
+
+QString VerticalTextDocument::toHtml(qreal columnSpacing) const
+{
+    TRACE_SCOPE(lcTraceExport, "VerticalTextDocument::toHtml");
+    QTextDocument doc;
+    QTextCursor cursor(&doc);
+    QHash<int, QTextCharFormat> charFormats;
+    const int n = columnCount();
+    for (int i = 0; i < n; ++i) {
+        const QString s = text(i);
+        //相同格式的连续文字一次插入
+        int j = 0;
+        while (j < s.length()) {
+            const int id = formatAt(i, j);
+            int k = j + 1;
+            while (k < s.length() && formatAt(i, k) == id) {
+                ++k;
+            }
+            QHash<int, QTextCharFormat>::iterator it = charFormats.find(id);
+            if (it == charFormats.end()) {
+                const SCharFormat sf = CFormatRegistry::format(id);
+                QFont font;
+                sf.setFont(&font);
+                QTextCharFormat tf;
+                tf.setFont(font);
+                tf.setForeground(sf.fontColor);
+                it = charFormats.insert(id, tf);
+            }
+            cursor.insertText(s.mid(j, k - j), it.value());
+            j = k;
+        }
+        if (i != n - 1)
+            cursor.insertText("\n");
+    }
+    QTextBlockFormat blockFormat = cursor.blockFormat();
+    blockFormat.setLineHeight(columnSpacing, QTextBlockFormat::LineDistanceHeight);
+    cursor.setBlockFormat(blockFormat);
+    return doc.toHtml();
+}
+
+void VerticalTextDocument::save(QDataStream& out, qreal columnSpacing) const
+{
+    //格式ID只在进程内有效，保存时换成文档内的序号
+    QHash<int, qint32> local;
+    QVector<int> ids;
+    for (const ChunkPointer& c : m_chunks) {
+        for (const QVector<int>& f : c->formats) {
+            for (int id : f) {
+                if (!local.contains(id)) {
+                    local.insert(id, ids.size());
+                    ids << id;
+                }
+            }
+        }
+    }
+    out.setVersion(QDataStream::Qt_5_9);
+    out << NATIVE_MAGIC << NATIVE_VERSION << columnSpacing;
+    out << quint32(ids.size());
+    for (int id : ids) {
+        out << CFormatRegistry::format(id);
+    }
+    const int n = columnCount();
+    out << quint32(n);
+    for (int i = 0; i < n; ++i) {
+        const QVector<int> f = formats(i);
+        QVector<qint32> indexes(f.size());
+        for (int j = 0; j < f.size(); ++j) {
+            indexes[j] = local.value(f.at(j));
+        }
+        out << text(i) << indexes;
+    }
+}
+
+VerticalTextDocument VerticalTextDocument::load(QDataStream& in, qreal* columnSpacing, bool* ok)
+{
+    if (ok) *ok = false;
+    in.setVersion(QDataStream::Qt_5_9);
+    quint32 magic = 0;
+    quint16 version = 0;
+    qreal spacing = 0;
+    in >> magic >> version >> spacing;
+    if (magic != NATIVE_MAGIC || version != NATIVE_VERSION || in.status() != QDataStream::Ok)
+        return VerticalTextDocument();
+
+    quint32 formatCount = 0;
+    in >> formatCount;
+    QVector<int> ids;
+    for (quint32 i = 0; i < formatCount && in.status() == QDataStream::Ok; ++i) {
+        SCharFormat sf;
+        in >> sf;
+        ids << CFormatRegistry::intern(sf);
+    }
+    quint32 columnCount = 0;
+    in >> columnCount;
+    if (in.status() != QDataStream::Ok || columnCount == 0)
+        return VerticalTextDocument();
+
+    VerticalTextDocument d;
+    for (quint32 i = 0; i < columnCount; ++i) {
+        QString text;
+        QVector<qint32> indexes;
+        in >> text >> indexes;
+        if (in.status() != QDataStream::Ok || indexes.size() != text.length())
+            return VerticalTextDocument();
+        QVector<int> f(indexes.size());
+        for (int j = 0; j < indexes.size(); ++j) {
+            const qint32 k = indexes.at(j);
+            if (k < 0 || k >= ids.size())
+                return VerticalTextDocument();
+            f[j] = ids.at(k);
+        }
+        if (i == 0)
+            d.setColumn(0, text, f);
+        else
+            d.appendColumn(text, f);
+    }
+    if (columnSpacing) *columnSpacing = spacing;
+    if (ok) *ok = true;
+    return d;
+}
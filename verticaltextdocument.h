@@ -0,0 +1,141 @@
+#ifndef VERTICALTEXTDOCUMENT_H
+#define VERTICALTEXTDOCUMENT_H
+
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QStringView>
+#include <QSharedPointer>
+#include <QSharedData>
+#include "scharformat.h"
+#include "cmappedtextfile.h"
+
+class QTextDocument;
+
+//文本范围（列号+列内位置），start不大于end
+typedef struct STextRange{
+    int startCol = 0;
+    int startPos = 0;
+    int endCol = 0;
+    int endPos = 0;
+
+    bool isEmpty() const { return startCol == endCol && startPos == endPos; }
+} STextRange;
+
+//文档模型：按列保存文字及每个字符的格式ID（见CFormatRegistry），至少有一列
+//列按块保存，块在副本之间隐式共享：复制文档是O(1)的快照，可交给撤销栈或其他线程无锁读取，
+//之后的修改只复制涉及的块
+//映射文件的文档是只读的：列来自CMappedTextFile，全部使用默认格式，不能修改
+class VerticalTextDocument
+{
+public:
+    VerticalTextDocument();
+
+    int columnCount() const { return m_mapped ? m_mapped->lineCount() : m_columnCount; }
+    QString text(int col) const {
+        if (m_mapped)
+            return m_mapped->line(col);
+        int k;
+        return chunkAt(col, &k).texts.at(k);
+    }
+    //映射文件时为空，按formatAt取格式
+    QVector<int> formats(int col) const {
+        if (m_mapped)
+            return QVector<int>();
+        int k;
+        return chunkAt(col, &k).formats.at(k);
+    }
+    int columnLength(int col) const { return text(col).length(); }
+    //超出范围时返回默认格式
+    int formatAt(int col, int pos) const;
+    bool isEmpty() const { return columnCount() == 1 && columnLength(0) == 0; }
+    //最长一列的字符数（按块统计，映射文件时由索引统计，不解码）
+    int maxColumnLength() const;
+
+    static VerticalTextDocument fromMappedFile(const QSharedPointer<CMappedTextFile>& file);
+    bool isMapped() const { return !m_mapped.isNull(); }
+    const CMappedTextFile* mappedFile() const { return m_mapped.data(); }
+
+    //toPlainText()中的偏移所在的列和列内位置（列间换行计1），按块的偏移二分查找；超出末尾时为最后一列末尾
+    void columnAtOffset(qint64 offset, int* col, int* pos) const;
+    QString toPlainText() const;
+    QString toPlainText(const STextRange& r) const;
+    STextRange fullRange() const;
+
+    void clear();
+    void setColumn(int col, const QString& text, const QVector<int>& formats);
+    //在col列pos处插入另一文档，返回插入结束位置
+    void insert(int col, int pos, const VerticalTextDocument& other, int* endCol = nullptr, int* endPos = nullptr);
+    void remove(const STextRange& r);
+    //把文本追加到末尾，遇到换行开始新列
+    void append(QStringView text, int formatId);
+    //移出开头的count列（至少保留一列），整块移出是常数时间
+    void removeFirstColumns(int count);
+    //修改范围内字符格式，fn接收SCharFormat&
+    template<typename Fn> void updateFormats(const STextRange& r, Fn fn);
+
+    static VerticalTextDocument fromTextDocument(const QTextDocument* doc);
+    //html导入，columnSpacing返回保存时写入的列间距
+    static VerticalTextDocument fromHtml(const QString& html, qreal* columnSpacing = nullptr);
+    QString toHtml(qreal columnSpacing) const;
+    //原生二进制格式（.vtd）：格式表 + 每列文字和格式序号，读取失败时返回空文档并把ok置为false
+    void save(QDataStream& out, qreal columnSpacing) const;
+    static VerticalTextDocument load(QDataStream& in, qreal* columnSpacing = nullptr, bool* ok = nullptr);
+    //每块的列数，块超过两倍时拆分
+    static const int ChunkColumns = 256;
+private:
+    typedef struct SChunk : public QSharedData{
+        QStringList          texts;
+        QList<QVector<int>>  formats;
+        int                  maxLength = 0;     //块内最长一列的字符数
+        int                  chars = 0;         //块内各列字符数之和
+
+        //整块重新统计
+        void updateStats();
+    } SChunk;
+    typedef QSharedDataPointer<SChunk> ChunkPointer;
+
+    //列所在的块，offset返回块内下标
+    int chunkIndex(int col) const;
+    const SChunk& chunkAt(int col, int* offset) const;
+    //只复制col所在的块（和块表）
+    SChunk& mutableChunkAt(int col, int* offset);
+    //用texts、formats替换从first开始的removed列，只重建首尾涉及的块
+    void replaceColumns(int first, int removed, const QStringList& texts, const QList<QVector<int>>& formats);
+    void appendColumn(const QString& text, const QVector<int>& formats);
+    //更新from之后各块的起始列号和偏移
+    void updateChunkStarts(int from);
+private:
+    QList<ChunkPointer>    m_chunks;        //至少一块，块不为空
+    QList<qint64>          m_chunkStarts;   //各块第一列的绝对列号
+    QList<qint64>          m_chunkOffsets;  //各块第一列在全文中的偏移（含已移出的列）
+    qint64                 m_offsetBase = 0;    //第0列的偏移
+    qint64                 m_base = 0;      //已移出的列数，列号col的绝对列号为m_base + col
+    int                    m_columnCount = 0;
+    QSharedPointer<CMappedTextFile> m_mapped;
+};
+
+template<typename Fn>
+void VerticalTextDocument::updateFormats(const STextRange& r, Fn fn)
+{
+    Q_ASSERT(!m_mapped);
+    //同一格式只转换一次
+    QHash<int, int> mapped;
+    for (int i = r.startCol; i <= r.endCol; ++i) {
+        int k;
+        QVector<int>& f = mutableChunkAt(i, &k).formats[k];
+        const int bp = (i == r.startCol ? r.startPos : 0);
+        const int ep = qMin(i == r.endCol ? r.endPos : f.size(), f.size());
+        for (int j = bp; j < ep; ++j) {
+            QHash<int, int>::const_iterator it = mapped.constFind(f.at(j));
+            if (it == mapped.constEnd()) {
+                SCharFormat sf = CFormatRegistry::format(f.at(j));
+                fn(sf);
+                it = mapped.insert(f.at(j), CFormatRegistry::intern(sf));
+            }
+            f[j] = it.value();
+        }
+    }
+}
+
+#endif // VERTICALTEXTDOCUMENT_H
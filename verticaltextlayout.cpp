@@ -0,0 +1,1006 @@
+#include "verticaltextlayout.h"
+#include <QPainter>
+#include <QThread>
+#include <QtMath>
+#include <QAtomicInteger>
+#include <QtConcurrent>
+#include "ctrace.h"
+#include "cglyphcache.h"
+#include <algorithm>
+
+const qreal VerticalTextLayout::Margin = 5.0;
+const qreal VerticalTextLayout::MinimumSize = 300;
+const int VerticalTextLayout::VirtualColumns = 4096;
+
+static const QColor SELECTED_TEXT_COLOR("#FFF8F0");
+static const QColor SELECTION_COLOR("#0078D7");
+//失效列达到此数量时并行度量
+static const int PARALLEL_COLUMNS = 512;
+//字符高度达到此像素数时按轮廓绘制
+static const qreal LARGE_GLYPH_PIXELS = 64;
+//移出的列达到此数量且超过一半时整理缓存
+static const int COMPACT_COLUMNS = 1024;
+//列度量的序号，预生成的字形串按序号缓存
+static QAtomicInteger<quint32> s_serial;
+
+VerticalTextLayout::VerticalTextLayout()
+{
+    m_window.setMaxCost(VirtualColumns);
+}
+
+void VerticalTextLayout::setDocument(const VerticalTextDocument* doc)
+{
+    m_doc = doc;
+    invalidate();
+}
+
+void VerticalTextLayout::setOrientation(Orientation o)
+{
+    if (m_orientation == o)
+        return;
+    m_orientation = o;
+    invalidate();
+}
+
+void VerticalTextLayout::setColumnSpacing(qreal spacing)
+{
+    if (m_columnSpacing == spacing)
+        return;
+    m_columnSpacing = spacing;
+    m_prefixValid = 0;
+    ++m_revision;
+}
+
+void VerticalTextLayout::setEmptyColumnFormat(int formatId)
+{
+    if (m_emptyFormat == formatId)
+        return;
+    m_emptyFormat = formatId;
+    ++m_revision;
+    //只影响空列
+    if (!m_doc)
+        return;
+    if (m_virtual) {
+        m_window.clear();
+        return;
+    }
+    for (int i = 0; i < m_columns.size() - m_head && i < m_doc->columnCount(); ++i) {
+        if (m_doc->columnLength(i) == 0) {
+            m_columns[m_head + i].valid = false;
+            m_prefixValid = qMin(m_prefixValid, i);
+        }
+    }
+}
+
+void VerticalTextLayout::columnsChanged(int first, int removed, int inserted)
+{
+    if (m_virtual) {
+        //列数变化时其后的列下标都会移动
+        const QList<qint64> keys = m_window.keys();
+        for (qint64 key : keys) {
+            const qint64 k = key - m_evicted;
+            if (k >= first && (removed != inserted || k < first + removed))
+                m_window.remove(key);
+        }
+        m_extentValid = false;
+        ++m_revision;
+        return;
+    }
+    if (first > m_columns.size() - m_head) {
+        invalidate();
+        return;
+    }
+    removed = qMin(removed, m_columns.size() - m_head - first);
+    dropExtents(m_head + first, removed);
+    //只修改有变化的部分，其他列的度量保留
+    const int common = qMin(removed, inserted);
+    for (int i = 0; i < common; ++i) {
+        m_columns[m_head + first + i] = SColumnMetrics();
+    }
+    if (removed > common) {
+        m_columns.remove(m_head + first + common, removed - common);
+    } else if (inserted > common) {
+        m_columns.insert(m_head + first + common, inserted - common, SColumnMetrics());
+    }
+    m_prefixValid = qMin(m_prefixValid, first);
+    ++m_revision;
+}
+
+void VerticalTextLayout::invalidate()
+{
+    m_columns.clear();
+    m_head = 0;
+    if (m_doc && !m_virtual)
+        m_columns.resize(m_doc->columnCount());
+    m_prepared.clear();
+    m_window.clear();
+    m_pitch = 0;
+    m_advance = 0;
+    m_starts.clear();
+    m_prefixValid = 0;
+    m_extentValid = false;
+    ++m_revision;
+}
+
+void VerticalTextLayout::columnsEvicted(int count)
+{
+    if (count <= 0)
+        return;
+    ++m_revision;
+    if (m_virtual) {
+        //窗口按绝对列号缓存，剩下的列不用移动
+        m_extentValid = false;
+        m_evicted += count;
+        return;
+    }
+    if (count >= m_columns.size() - m_head) {
+        invalidate();
+        return;
+    }
+    dropExtents(m_head, count);
+    //只移动起点，列起点按第一列的起点换算，不用重算前缀和
+    m_head += count;
+    m_prefixValid = qMax(0, m_prefixValid - count);
+    if (m_starts.size() < m_head) {
+        m_starts.resize(m_head);
+        m_prefixValid = 0;
+    }
+    //被移出的部分超过一半时整理一次，均摊到每列是常数
+    if (m_head >= COMPACT_COLUMNS && m_head * 2 >= m_columns.size()) {
+        m_columns.remove(0, m_head);
+        m_starts.remove(0, m_head);
+        m_head = 0;
+    }
+}
+
+void VerticalTextLayout::dropExtents(int index, int count)
+{
+    //最大长度只在移走最长的列时重新统计，其他情况下新度量的列直接并入
+    if (!m_extentValid)
+        return;
+    for (int i = index; i < index + count; ++i) {
+        const SColumnMetrics& cm = m_columns.at(i);
+        if (cm.valid && cm.extent >= m_maxExtent) {
+            m_extentValid = false;
+            return;
+        }
+    }
+}
+
+void VerticalTextLayout::setVirtualized(bool enabled)
+{
+    if (m_virtual == enabled)
+        return;
+    m_virtual = enabled;
+    invalidate();
+}
+
+void VerticalTextLayout::setAlignment(int alignment)
+{
+    if (m_alignment == alignment)
+        return;
+    m_alignment = alignment;
+    ++m_revision;
+}
+
+void VerticalTextLayout::assignMetrics(const VerticalTextLayout& other, const VerticalTextDocument* doc)
+{
+    m_doc = doc;
+    m_orientation = other.m_orientation;
+    m_alignment = other.m_alignment;
+    m_columnSpacing = other.m_columnSpacing;
+    m_emptyFormat = other.m_emptyFormat;
+    m_columns = other.m_columns;
+    m_starts = other.m_starts;
+    m_head = other.m_head;
+    m_prefixValid = other.m_prefixValid;
+    m_maxExtent = other.m_maxExtent;
+    m_extentValid = other.m_extentValid;
+    m_revision = other.m_revision;
+    //虚拟模式的已度量列不复制，按需重新度量
+    m_virtual = other.m_virtual;
+    m_window.clear();
+    m_evicted = other.m_evicted;
+    m_pitch = other.m_pitch;
+    m_advance = other.m_advance;
+}
+
+const VerticalTextLayout::SFontInfo& VerticalTextLayout::fontInfo(FontTable& fonts, int formatId)
+{
+    FontTable::const_iterator it = fonts.constFind(formatId);
+    if (it != fonts.constEnd())
+        return it.value();
+
+    const SCharFormat sf = CFormatRegistry::format(formatId);
+    SFontInfo fi;
+    sf.setFont(&fi.font);
+    //把删除线，上下划线属性去除，效果不好，竖排时自定义实现
+    fi.plainFont = fi.font;
+    fi.plainFont.setUnderline(false);
+    fi.plainFont.setStrikeOut(false);
+    fi.plainFont.setOverline(false);
+    fi.metrics = QFontMetricsF(fi.plainFont);
+    fi.color = sf.fontColor;
+    fi.letterSpacing = sf.letterSpacing;
+    fi.underline = sf.underline;
+    fi.overline = sf.overline;
+    fi.strikeOut = sf.strikeOut;
+    fi.largeGlyphs = fi.metrics.height() >= LARGE_GLYPH_PIXELS;
+    fi.rawFont = QRawFont::fromFont(fi.plainFont);
+    return fonts.insert(formatId, fi).value();
+}
+
+qreal VerticalTextLayout::charWidth(const SFontInfo& fi, QChar c) const
+{
+    QHash<ushort, qreal>::const_iterator it = fi.widths.constFind(c.unicode());
+    if (it != fi.widths.constEnd())
+        return it.value();
+    const qreal w = fi.metrics.width(c);
+    fi.widths.insert(c.unicode(), w);
+    return w;
+}
+
+void VerticalTextLayout::measureColumn(int col, SColumnMetrics& cm, FontTable& fonts) const
+{
+    const QString s = m_doc->text(col);
+    QVector<int> f = m_doc->formats(col);
+    const int n = s.length();
+    const bool vertical = (m_orientation == Vertical);
+    cm.shape.reset();
+    cm.shapeKey = 0;
+    if (n > 0) {
+        //缺省格式因文档而异，补齐后再作为键
+        if (f.size() != n) {
+            const int known = qMin(f.size(), n);
+            f.resize(n);
+            for (int j = known; j < n; ++j) {
+                f[j] = m_doc->formatAt(col, j);
+            }
+        }
+        cm.shapeKey = CShapeCache::key(s, f, vertical);
+        if (CShapeCache::ColumnPointer shape = CShapeCache::find(cm.shapeKey, s, f, vertical)) {
+            cm.offsets = shape->offsets;
+            cm.runs = shape->runs;
+            cm.sideways = shape->sideways;
+            cm.thickness = shape->thickness;
+            cm.extent = shape->extent;
+            cm.shape = shape;
+            cm.serial = s_serial.fetchAndAddRelaxed(1) + 1;
+            cm.valid = true;
+            return;
+        }
+    }
+    cm.offsets.resize(n + 1);
+    cm.runs.clear();
+    cm.sideways.clear();
+    bool sideways = false;
+    qreal pos = 0;
+    qreal thickness = 0;
+    qreal lastSpacing = 0;
+    int lastId = -1;
+    const SFontInfo* fi = nullptr;
+    for (int j = 0; j < n; ++j) {
+        const int id = f.at(j);
+        if (id != lastId) {
+            fi = &fontInfo(fonts, id);
+            lastId = id;
+            cm.runs << j;
+            const qreal t = (m_orientation == Vertical ? qMax(fi->metrics.height(), fi->metrics.maxWidth())
+                                                       : fi->metrics.height());
+            thickness = qMax(thickness, t);
+        }
+        //方向分段只在度量时做一次，绘制时按段处理
+        const QChar c = s.at(j);
+        const bool sw = vertical && isSideways(c);
+        if (sw != sideways) {
+            cm.sideways << j;
+            sideways = sw;
+        }
+        cm.offsets[j] = pos;
+        pos += (vertical && !sw ? fi->metrics.height() : charWidth(*fi, c)) + fi->letterSpacing;
+        lastSpacing = fi->letterSpacing;
+    }
+    if (sideways)
+        cm.sideways << n;
+    cm.offsets[n] = pos;
+    cm.extent = (n > 0 ? pos - lastSpacing : 0);
+    if (n == 0) {
+        //空列按输入格式计算
+        const SFontInfo& efi = fontInfo(fonts, m_emptyFormat >= 0 ? m_emptyFormat : m_doc->formatAt(col, 0));
+        thickness = (m_orientation == Vertical ? qMax(efi.metrics.height(), efi.metrics.maxWidth())
+                                               : efi.metrics.height());
+    }
+    cm.thickness = thickness;
+    cm.serial = s_serial.fetchAndAddRelaxed(1) + 1;
+    cm.valid = true;
+    if (n > 0) {
+        CShapeCache::SShapedColumn* shape = new CShapeCache::SShapedColumn;
+        shape->text = s;
+        shape->formats = f;
+        shape->vertical = vertical;
+        shape->thickness = cm.thickness;
+        shape->extent = cm.extent;
+        shape->offsets = cm.offsets;
+        shape->runs = cm.runs;
+        shape->sideways = cm.sideways;
+        cm.shape = CShapeCache::ColumnPointer(shape);
+        CShapeCache::insert(cm.shapeKey, cm.shape);
+    }
+}
+
+const VerticalTextLayout::SColumnMetrics& VerticalTextLayout::column(int col) const
+{
+    if (m_virtual) {
+        if (SColumnMetrics* cached = m_window.object(m_evicted + col)) {
+            ++m_stats.columnHits;
+            return *cached;
+        }
+        ++m_stats.columnMisses;
+        ensureEstimates();
+        SColumnMetrics* cm = new SColumnMetrics;
+        measureColumn(col, *cm, m_fonts);
+        refineEstimates(*cm);
+        //最久未用的列被淘汰，内存与视口大小成正比
+        m_window.insert(m_evicted + col, cm);
+        return *cm;
+    }
+    if (m_columns.size() - m_head != m_doc->columnCount()) {
+        //调用方漏掉了columnsChanged，全部重新计算
+        m_columns.clear();
+        m_head = 0;
+        m_columns.resize(m_doc->columnCount());
+        m_prefixValid = 0;
+        m_extentValid = false;
+        ++m_revision;
+    }
+    //已度量的列只读访问，共享度量数据的副本不会因此分离
+    const SColumnMetrics& cached = m_columns.at(m_head + col);
+    if (cached.valid) {
+        ++m_stats.columnHits;
+        return cached;
+    }
+    ++m_stats.columnMisses;
+    SColumnMetrics& cm = m_columns[m_head + col];
+    measureColumn(col, cm, m_fonts);
+    if (m_extentValid)
+        m_maxExtent = qMax(m_maxExtent, cm.extent);
+    return cm;
+}
+
+void VerticalTextLayout::measureInvalidColumns() const
+{
+    const int n = m_doc->columnCount();
+    if (!m_parallel || n < PARALLEL_COLUMNS || QThread::idealThreadCount() < 2)
+        return;
+    if (m_columns.size() - m_head != n) {
+        m_columns.clear();
+        m_head = 0;
+        m_columns.resize(n);
+        m_prefixValid = 0;
+        m_extentValid = false;
+    }
+    //失效的列都在m_prefixValid之后，追加和移出时只检查新列
+    QVector<int> invalid;
+    for (int i = m_prefixValid; i < n; ++i) {
+        if (!m_columns.at(m_head + i).valid)
+            invalid << i;
+    }
+    if (invalid.size() < PARALLEL_COLUMNS)
+        return;
+
+    TRACE_SCOPE(lcTraceLayout, "VerticalTextLayout::measureInvalidColumns");
+    //各列互不依赖，按块分给工作线程；每块使用自己的字体表，QFont不在线程间共享
+    typedef struct SChunk{
+        int begin;
+        int end;
+    } SChunk;
+    const int chunkCount = QThread::idealThreadCount() * 4;
+    const int chunkSize = (invalid.size() + chunkCount - 1) / chunkCount;
+    QVector<SChunk> chunks;
+    for (int i = 0; i < invalid.size(); i += chunkSize) {
+        chunks.append({i, qMin(i + chunkSize, invalid.size())});
+    }
+    SColumnMetrics* columns = m_columns.data() + m_head;
+    const int* cols = invalid.constData();
+    QtConcurrent::blockingMap(chunks, [this, columns, cols](const SChunk& chunk) {
+        FontTable fonts;
+        for (int k = chunk.begin; k < chunk.end; ++k) {
+            measureColumn(cols[k], columns[cols[k]], fonts);
+        }
+    });
+    m_stats.columnMisses += invalid.size();
+    m_prefixValid = qMin(m_prefixValid, invalid.first());
+    if (m_extentValid) {
+        for (int i : invalid) {
+            m_maxExtent = qMax(m_maxExtent, columns[i].extent);
+        }
+    }
+}
+
+void VerticalTextLayout::refineEstimates(const SColumnMetrics& cm) const
+{
+    bool grown = false;
+    if (cm.thickness > m_pitch) {
+        m_pitch = cm.thickness;
+        grown = true;
+    }
+    const int n = cm.offsets.size() - 1;
+    if (n > 0 && cm.extent > n * m_advance) {
+        m_advance = cm.extent / n;
+        grown = true;
+    }
+    if (grown) {
+        //字形串的位置依赖列宽
+        m_prepared.clear();
+        m_extentValid = false;
+        ++m_revision;
+    }
+}
+
+void VerticalTextLayout::ensureEstimates() const
+{
+    if (m_pitch <= 0) {
+        //按输入格式估计，度量到实际列后修正
+        const SFontInfo& fi = fontInfo(m_emptyFormat >= 0 ? m_emptyFormat : m_doc->formatAt(0, 0));
+        m_pitch = (m_orientation == Vertical ? qMax(fi.metrics.height(), fi.metrics.maxWidth()) : fi.metrics.height());
+        m_advance = (m_orientation == Vertical ? fi.metrics.height() : fi.metrics.averageCharWidth()) + fi.letterSpacing;
+    }
+    if (!m_extentValid) {
+        //只读取各列字数，不度量
+        m_maxExtent = m_doc->maxColumnLength() * m_advance;
+        m_extentValid = true;
+    }
+}
+
+void VerticalTextLayout::ensurePrefix() const
+{
+    if (m_virtual) {
+        ensureEstimates();
+        return;
+    }
+    const int n = m_doc->columnCount();
+    if (m_prefixValid == n && m_starts.size() == m_head + n && m_extentValid)
+        return;
+    TRACE_SCOPE(lcTraceLayout, "VerticalTextLayout::ensurePrefix");
+    measureInvalidColumns();
+    if (m_starts.size() != m_head + n) {
+        m_starts.resize(m_head + n);
+        m_prefixValid = qMin(m_prefixValid, n);
+    }
+    //保存的起点以曾经的第一列为原点，移出前面的列后不必重算
+    for (int i = m_prefixValid; i < n; ++i) {
+        m_starts[m_head + i] = (i == 0 ? 0 : m_starts.at(m_head + i - 1) + column(i - 1).thickness + m_columnSpacing);
+    }
+    m_prefixValid = n;
+    if (!m_extentValid) {
+        m_maxExtent = 0;
+        for (int i = 0; i < n; ++i) {
+            m_maxExtent = qMax(m_maxExtent, column(i).extent);
+        }
+        m_extentValid = true;
+    }
+}
+
+QRectF VerticalTextLayout::boundingRect() const
+{
+    if (!m_doc)
+        return QRectF();
+    ensurePrefix();
+    const int n = m_doc->columnCount();
+    const qreal total = columnStart(n - 1) + columnThickness(n - 1);
+    const qreal maxSize = qMax(MinimumSize, m_maxExtent);
+    if (m_orientation == Vertical) {
+        return QRectF(-total/2 - Margin, -maxSize/2 - Margin, total + 2*Margin, maxSize + 2*Margin);
+    }
+    return QRectF(-maxSize/2 - Margin, -total/2 - Margin, maxSize + 2*Margin, total + 2*Margin);
+}
+
+qreal VerticalTextLayout::columnStart(int col) const
+{
+    ensurePrefix();
+    if (m_virtual)
+        return col * (m_pitch + m_columnSpacing);
+    return m_starts.at(m_head + col) - m_starts.at(m_head);
+}
+
+qreal VerticalTextLayout::columnThickness(int col) const
+{
+    if (m_virtual) {
+        ensureEstimates();
+        return m_pitch;
+    }
+    return column(col).thickness;
+}
+
+qreal VerticalTextLayout::columnExtent(int col) const
+{
+    return column(col).extent;
+}
+
+QRectF VerticalTextLayout::columnRect(int col) const
+{
+    const QRectF r = boundingRect();
+    const qreal start = columnStart(col);
+    const qreal thickness = columnThickness(col);
+    if (m_orientation == Vertical) {
+        const qreal right = r.right() - Margin - start;
+        return QRectF(right - thickness, r.top() + Margin, thickness, r.height() - 2*Margin);
+    }
+    return QRectF(r.left() + Margin, r.top() + Margin + start, r.width() - 2*Margin, thickness);
+}
+
+qreal VerticalTextLayout::flowStartFor(qreal extent) const
+{
+    const QRectF r = boundingRect();
+    if (m_orientation == Vertical) {
+        if (m_alignment == AlignCenter)
+            return r.center().y() - extent/2;
+        if (m_alignment == AlignBottom)
+            return r.bottom() - Margin - extent;
+        return r.top() + Margin;
+    }
+    if (m_alignment == AlignRight)
+        return r.right() - Margin - extent;
+    if (m_alignment == AlignHCenter)
+        return r.center().x() - extent/2;
+    return r.left() + Margin;
+}
+
+qreal VerticalTextLayout::charPosition(int col, int pos) const
+{
+    const SColumnMetrics& cm = column(col);
+    return flowStart(col) + cm.offsets.at(qBound(0, pos, cm.offsets.size() - 1));
+}
+
+QLineF VerticalTextLayout::caretLine(int col, int pos) const
+{
+    const QRectF cr = columnRect(col);
+    const qreal p = charPosition(col, pos);
+    if (m_orientation == Vertical)
+        return QLineF(cr.left(), p, cr.right(), p);
+    return QLineF(p, cr.top(), p, cr.bottom());
+}
+
+QVector<QRectF> VerticalTextLayout::selectionRects(const STextRange& r) const
+{
+    QVector<QRectF> rects;
+    if (r.isEmpty())
+        return rects;
+    for (int i = r.startCol; i <= r.endCol; ++i) {
+        const int bp = (i == r.startCol ? r.startPos : 0);
+        const int ep = (i == r.endCol ? r.endPos : m_doc->columnLength(i));
+        if (ep == bp)
+            continue;
+        const QRectF cr = columnRect(i);
+        const qreal a = charPosition(i, bp);
+        const qreal b = charPosition(i, ep);
+        if (m_orientation == Vertical) {
+            rects << QRectF(cr.left(), a, cr.width(), b - a);
+        } else {
+            rects << QRectF(a, cr.top(), b - a, cr.height());
+        }
+    }
+    return rects;
+}
+
+int VerticalTextLayout::firstColumnAt(qreal distance) const
+{
+    ensurePrefix();
+    if (m_virtual) {
+        const qreal step = m_pitch + m_columnSpacing;
+        const int idx = (step > 0 ? qFloor(distance / step) : 0);
+        return qBound(0, idx, m_doc->columnCount() - 1);
+    }
+    //最后一个起点不大于distance的列
+    const QVector<qreal>::const_iterator begin = m_starts.constBegin() + m_head;
+    const int idx = int(std::upper_bound(begin, m_starts.constEnd(), distance + *begin) - begin) - 1;
+    return qBound(0, idx, m_doc->columnCount() - 1);
+}
+
+void VerticalTextLayout::hitTest(const QPointF& p, int* col, int* pos) const
+{
+    TRACE_SCOPE(lcTraceHitTest, "VerticalTextLayout::hitTest");
+    const QRectF r = boundingRect();
+    const qreal d = (m_orientation == Vertical ? r.right() - Margin - p.x() : p.y() - r.top() - Margin);
+    const int c = firstColumnAt(d);
+    const QVector<qreal>& o = column(c).offsets;
+    const qreal f = (m_orientation == Vertical ? p.y() : p.x()) - flowStart(c);
+    const int n = o.size() - 1;
+    const int k = int(std::upper_bound(o.constBegin(), o.constEnd(), f) - o.constBegin()) - 1;
+    *col = c;
+    if (k < 0) {
+        *pos = 0;
+    } else if (k >= n) {
+        *pos = n;
+    } else {
+        //取最近的字符间隙
+        *pos = (f - o.at(k) > (o.at(k + 1) - o.at(k))/2 ? k + 1 : k);
+    }
+}
+
+void VerticalTextLayout::columnRangeFor(const QRectF& exposed, int* first, int* last) const
+{
+    *first = 0;
+    *last = m_doc->columnCount() - 1;
+    if (exposed.isNull())
+        return;
+    const QRectF r = boundingRect();
+    if (m_orientation == Vertical) {
+        *first = firstColumnAt(r.right() - Margin - exposed.right());
+        *last = firstColumnAt(r.right() - Margin - exposed.left());
+    } else {
+        *first = firstColumnAt(exposed.top() - r.top() - Margin);
+        *last = firstColumnAt(exposed.bottom() - r.top() - Margin);
+    }
+}
+
+//列内可见字符范围
+static void charRangeFor(const QVector<qreal>& offsets, qreal lo, qreal hi, int* first, int* last)
+{
+    const int n = offsets.size() - 1;
+    *first = qMax(0, int(std::upper_bound(offsets.constBegin(), offsets.constEnd(), lo) - offsets.constBegin()) - 1);
+    *last = qMin(n - 1, int(std::lower_bound(offsets.constBegin(), offsets.constEnd(), hi) - offsets.constBegin()));
+}
+
+void VerticalTextLayout::draw(QPainter* painter, const STextRange& selection, const QRectF& exposed) const
+{
+    if (!m_doc)
+        return;
+    TRACE_SCOPE(lcTracePaint, "VerticalTextLayout::draw");
+    //绘制选中区域
+    if (!selection.isEmpty()) {
+        painter->save();
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(SELECTION_COLOR);
+        const QVector<QRectF> rects = selectionRects(selection);
+        for (const QRectF& rect : rects) {
+            painter->drawRect(rect);
+        }
+        painter->restore();
+    }
+    //绘制文字
+    int first, last;
+    columnRangeFor(exposed, &first, &last);
+    const QRectF clip = (exposed.isNull() ? boundingRect() : exposed);
+    painter->save();
+    if (m_orientation == Vertical) {
+        //轮廓填充需要抗锯齿
+        painter->setRenderHint(QPainter::Antialiasing);
+        drawVertical(painter, selection, first, last, clip);
+    } else {
+        drawHorizontal(painter, selection, first, last, clip);
+    }
+    painter->restore();
+}
+
+void VerticalTextLayout::drawHighlights(QPainter* painter, const QVector<STextRange>& ranges, const QColor& color, const QRectF& exposed) const
+{
+    if (!m_doc || ranges.isEmpty())
+        return;
+    TRACE_SCOPE(lcTracePaint, "VerticalTextLayout::drawHighlights");
+    int first, last;
+    columnRangeFor(exposed, &first, &last);
+    auto it = std::lower_bound(ranges.constBegin(), ranges.constEnd(), first,
+                               [](const STextRange& r, int col) { return r.endCol < col; });
+    QVector<QRectF> rects;
+    for (; it != ranges.constEnd() && it->startCol <= last; ++it) {
+        rects += selectionRects(*it);
+    }
+    painter->save();
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(color);
+    painter->drawRects(rects);
+    painter->restore();
+}
+
+void VerticalTextLayout::drawVerticalChar(QPainter* painter, const SFontInfo& fi, int formatId, QChar c,
+                                          const QRectF& cr, qreal y, const QColor& color) const
+{
+    const qreal cw = cr.width();
+    if (isSideways(c)) {
+        //西文等旋转90度，使用预先旋转的轮廓，不必切换坐标变换
+        const QPainterPath path = CGlyphCache::path(formatId, fi.plainFont, c, true);
+        painter->fillPath(path.translated(cr.left() + cw/4, y), color);
+    } else if (fi.largeGlyphs) {
+        const qreal w = charWidth(fi, c);
+        const QPainterPath path = CGlyphCache::path(formatId, fi.plainFont, c, false);
+        painter->fillPath(path.translated(cr.left() + (cw - w)/2, y + fi.metrics.ascent()), color);
+    } else {
+        const qreal w = charWidth(fi, c);
+        painter->drawText(QPointF(cr.left() + (cw - w)/2, y + fi.metrics.ascent()), QString(c));
+    }
+}
+void VerticalTextLayout::drawVerticalDecorations(QPainter* painter, const SFontInfo& fi, const QRectF& cr, qreal y, qreal next) const
+{
+    //左划线
+    if (fi.underline) {
+        painter->drawLine(QPointF(cr.left(), y), QPointF(cr.left(), next));
+    }
+    //右划线
+    if (fi.overline) {
+        painter->drawLine(QPointF(cr.right(), y), QPointF(cr.right(), next));
+    }
+    //删除线
+    if (fi.strikeOut) {
+        painter->drawLine(QPointF(cr.center().x(), y), QPointF(cr.center().x(), next));
+    }
+}
+void VerticalTextLayout::drawVertical(QPainter* painter, const STextRange& sel, int first, int last, const QRectF& clip) const
+{
+    QColor penColor;
+    int lastId = -1;
+    const SFontInfo* fi = nullptr;
+    for (int i = first; i <= last; ++i) {
+        if (m_doc->columnLength(i) == 0)
+            continue;
+        const SColumnMetrics& cm = column(i);
+        const QRectF cr = columnRect(i);
+        const qreal base = flowStart(i);
+        int jFirst, jLast;
+        charRangeFor(cm.offsets, clip.top() - base, clip.bottom() - base, &jFirst, &jLast);
+        if (jFirst > jLast)
+            continue;
+        m_stats.glyphs += jLast - jFirst + 1;
+        const bool inSel = !sel.isEmpty() && i >= sel.startCol && i <= sel.endCol;
+        if (!inSel) {
+            //未选中的列直接绘制预先生成的字形串
+            const QString s = m_doc->text(i);
+            for (const SPreparedRun& run : preparedRuns(i, cm)) {
+                if (run.end <= jFirst || run.begin > jLast)
+                    continue;
+                if (run.formatId != lastId) {
+                    fi = &fontInfo(run.formatId);
+                    painter->setFont(fi->plainFont);
+                    lastId = run.formatId;
+                }
+                if (fi->color != penColor) {
+                    painter->setPen(fi->color);
+                    penColor = fi->color;
+                }
+                const int b = qMax(run.begin, jFirst);
+                const int e = qMin(run.end, jLast + 1);
+                if (!run.glyphs.isEmpty()) {
+                    painter->drawGlyphRun(QPointF(cr.left(), base), run.glyphs);
+                } else {
+                    for (int j = b; j < e; ++j) {
+                        drawVerticalChar(painter, *fi, run.formatId, s.at(j), cr, base + cm.offsets.at(j), fi->color);
+                    }
+                }
+                drawVerticalDecorations(painter, *fi, cr, base + cm.offsets.at(b), base + cm.offsets.at(e));
+            }
+            continue;
+        }
+        const QString s = m_doc->text(i);
+        const QVector<int> f = m_doc->formats(i);
+        const int selBegin = (i == sel.startCol ? sel.startPos : 0);
+        const int selEnd = (i == sel.endCol ? sel.endPos : s.length());
+        for (int j = jFirst; j <= jLast; ++j) {
+            const int id = (j < f.size() ? f.at(j) : m_doc->formatAt(i, j));
+            if (id != lastId) {
+                fi = &fontInfo(id);
+                painter->setFont(fi->plainFont);
+                lastId = id;
+            }
+            const QColor color = (j >= selBegin && j < selEnd ? SELECTED_TEXT_COLOR : fi->color);
+            if (color != penColor) {
+                painter->setPen(color);
+                penColor = color;
+            }
+            const qreal y = base + cm.offsets.at(j);
+            drawVerticalChar(painter, *fi, id, s.at(j), cr, y, color);
+            drawVerticalDecorations(painter, *fi, cr, y, base + cm.offsets.at(j + 1));
+        }
+    }
+}
+
+void VerticalTextLayout::drawHorizontal(QPainter* painter, const STextRange& sel, int first, int last, const QRectF& clip) const
+{
+    QColor penColor;
+    int lastId = -1;
+    const SFontInfo* fi = nullptr;
+    for (int i = first; i <= last; ++i) {
+        if (m_doc->columnLength(i) == 0)
+            continue;
+        const SColumnMetrics& cm = column(i);
+        const QRectF cr = columnRect(i);
+        const qreal base = flowStart(i);
+        int jFirst, jLast;
+        charRangeFor(cm.offsets, clip.left() - base, clip.right() - base, &jFirst, &jLast);
+        if (jFirst > jLast)
+            continue;
+        m_stats.glyphs += jLast - jFirst + 1;
+        const QString s = m_doc->text(i);
+        const bool inSel = !sel.isEmpty() && i >= sel.startCol && i <= sel.endCol;
+        if (!inSel) {
+            for (const SPreparedRun& run : preparedRuns(i, cm)) {
+                if (run.end <= jFirst || run.begin > jLast)
+                    continue;
+                if (run.formatId != lastId) {
+                    fi = &fontInfo(run.formatId);
+                    painter->setFont(fi->font);
+                    lastId = run.formatId;
+                }
+                if (fi->color != penColor) {
+                    painter->setPen(fi->color);
+                    penColor = fi->color;
+                }
+                if (!run.glyphs.isEmpty()) {
+                    painter->drawGlyphRun(QPointF(base, cr.top()), run.glyphs);
+                    continue;
+                }
+                const int e = qMin(run.end, jLast + 1);
+                for (int j = qMax(run.begin, jFirst); j < e; ++j) {
+                    painter->drawText(QPointF(base + cm.offsets.at(j), cr.bottom() - fi->metrics.descent()), QString(s.at(j)));
+                }
+            }
+            continue;
+        }
+        const QVector<int> f = m_doc->formats(i);
+        const int selBegin = (i == sel.startCol ? sel.startPos : 0);
+        const int selEnd = (i == sel.endCol ? sel.endPos : s.length());
+        for (int j = jFirst; j <= jLast; ++j) {
+            const int id = (j < f.size() ? f.at(j) : m_doc->formatAt(i, j));
+            if (id != lastId) {
+                fi = &fontInfo(id);
+                painter->setFont(fi->font);
+                lastId = id;
+            }
+            const QColor color = (j >= selBegin && j < selEnd ? SELECTED_TEXT_COLOR : fi->color);
+            if (color != penColor) {
+                painter->setPen(color);
+                penColor = color;
+            }
+            painter->drawText(QPointF(base + cm.offsets.at(j), cr.bottom() - fi->metrics.descent()), QString(s.at(j)));
+        }
+    }
+}
+QVector<CShapeCache::SShapedRun> VerticalTextLayout::shapeRuns(int col, const SColumnMetrics& cm) const
+{
+    const QString s = m_doc->text(col);
+    const QVector<int> f = m_doc->formats(col);
+    const int n = s.length();
+    const bool vertical = (m_orientation == Vertical);
+    QVector<CShapeCache::SShapedRun> runs;
+    int j = 0;
+    int r = 0;
+    while (j < n) {
+        const int id = (j < f.size() ? f.at(j) : m_doc->formatAt(col, j));
+        //竖排时旋转字符单独成段，分段在度量时已完成
+        while (r < cm.sideways.size() && cm.sideways.at(r + 1) <= j) {
+            r += 2;
+        }
+        const bool sideways = (r < cm.sideways.size() && cm.sideways.at(r) <= j);
+        const int limit = (r < cm.sideways.size() ? cm.sideways.at(sideways ? r + 1 : r) : n);
+        int k = j + 1;
+        while (k < limit && (k < f.size() ? f.at(k) : m_doc->formatAt(col, k)) == id) {
+            ++k;
+        }
+        CShapeCache::SShapedRun run;
+        run.begin = j;
+        run.end = k;
+        run.formatId = id;
+        const SFontInfo& fi = fontInfo(id);
+        if (!sideways && !(vertical && fi.largeGlyphs) && fi.rawFont.isValid()) {
+            const QVector<quint32> indexes = fi.rawFont.glyphIndexesForString(s.mid(j, k - j));
+            //代理对等无法逐字对应时仍逐字绘制
+            if (indexes.size() == k - j) {
+                run.positions.resize(k - j);
+                for (int m = j; m < k; ++m) {
+                    run.positions[m - j] = (vertical ? QPointF(-charWidth(fi, s.at(m))/2, cm.offsets.at(m) + fi.metrics.ascent())
+                                                     : QPointF(cm.offsets.at(m), -fi.metrics.descent()));
+                }
+                run.glyphs = indexes;
+            }
+        }
+        runs << run;
+        j = k;
+    }
+    return runs;
+}
+
+const QVector<VerticalTextLayout::SPreparedRun>& VerticalTextLayout::preparedRuns(int col, const SColumnMetrics& cm) const
+{
+    QHash<quint32, QVector<SPreparedRun>>::const_iterator it = m_prepared.constFind(cm.serial);
+    if (it != m_prepared.constEnd())
+        return it.value();
+
+    //重新度量过的列序号会变化，旧项不再命中，积累过多时整体清掉
+    if (m_prepared.size() > (m_virtual ? m_window.size() : m_columns.size() - m_head) * 2 + 256)
+        m_prepared.clear();
+
+    const bool vertical = (m_orientation == Vertical);
+    const qreal thickness = columnThickness(col);
+    //字形序号和相对位置取自进程级缓存，QRawFont不跨线程共享，字形串在本布局内生成
+    QVector<CShapeCache::SShapedRun> shaped;
+    if (!cm.shape || !CShapeCache::findRuns(cm.shapeKey, cm.shape.data(), &shaped)) {
+        shaped = shapeRuns(col, cm);
+        if (cm.shape)
+            CShapeCache::insertRuns(cm.shapeKey, cm.shape.data(), shaped);
+    }
+    const QPointF shift = (vertical ? QPointF(thickness/2, 0) : QPointF(0, thickness));
+    QVector<SPreparedRun> runs;
+    runs.reserve(shaped.size());
+    for (const CShapeCache::SShapedRun& sr : shaped) {
+        SPreparedRun run;
+        run.begin = sr.begin;
+        run.end = sr.end;
+        run.formatId = sr.formatId;
+        if (!sr.glyphs.isEmpty()) {
+            const SFontInfo& fi = fontInfo(sr.formatId);
+            QVector<QPointF> positions(sr.positions.size());
+            for (int m = 0; m < positions.size(); ++m) {
+                positions[m] = sr.positions.at(m) + shift;
+            }
+            run.glyphs.setRawFont(fi.rawFont);
+            run.glyphs.setGlyphIndexes(sr.glyphs);
+            run.glyphs.setPositions(positions);
+            if (!vertical) {
+                run.glyphs.setUnderline(fi.underline);
+                run.glyphs.setOverline(fi.overline);
+                run.glyphs.setStrikeOut(fi.strikeOut);
+            }
+        }
+        runs << run;
+    }
+    return m_prepared.insert(cm.serial, runs).value();
+}
+
+qreal VerticalTextLayout::averageColumnThickness() const
+{
+    if (!m_doc)
+        return 0;
+    ensurePrefix();
+    const int n = m_doc->columnCount();
+    return (columnStart(n - 1) + columnThickness(n - 1) - (n - 1) * m_columnSpacing) / n;
+}
+
+void VerticalTextLayout::drawGreeked(QPainter* painter, const QRectF& exposed) const
+{
+    if (!m_doc)
+        return;
+    TRACE_SCOPE(lcTracePaint, "VerticalTextLayout::drawGreeked");
+    int first, last;
+    columnRangeFor(exposed, &first, &last);
+    painter->save();
+    painter->setPen(Qt::NoPen);
+    for (int i = first; i <= last; ++i) {
+        if (m_virtual && !m_window.contains(m_evicted + i)) {
+            //未度量的列按估计长度画一个色块，缩小浏览时不度量整个文档
+            const int length = m_doc->columnLength(i);
+            if (length == 0)
+                continue;
+            const QRectF cr = columnRect(i);
+            const qreal extent = length * m_advance;
+            const qreal base = flowStartFor(extent);
+            QColor color = fontInfo(m_doc->formatAt(i, 0)).color;
+            color.setAlpha(160);
+            if (m_orientation == Vertical) {
+                painter->fillRect(QRectF(cr.left() + cr.width()/4, base, cr.width()/2, extent), color);
+            } else {
+                painter->fillRect(QRectF(base, cr.top() + cr.height()/4, extent, cr.height()/2), color);
+            }
+            continue;
+        }
+        const SColumnMetrics& cm = column(i);
+        if (cm.runs.isEmpty())
+            continue;
+        const QRectF cr = columnRect(i);
+        const qreal base = flowStart(i);
+        const int n = cm.offsets.size() - 1;
+        for (int k = 0; k < cm.runs.size(); ++k) {
+            const int b = cm.runs.at(k);
+            const int e = (k + 1 < cm.runs.size() ? cm.runs.at(k + 1) : n);
+            QColor color = fontInfo(m_doc->formatAt(i, b)).color;
+            color.setAlpha(160);
+            //色块占列宽的一半，长度与文字相同
+            if (m_orientation == Vertical) {
+                painter->fillRect(QRectF(cr.left() + cr.width()/4, base + cm.offsets.at(b),
+                                         cr.width()/2, cm.offsets.at(e) - cm.offsets.at(b)), color);
+            } else {
+                painter->fillRect(QRectF(base + cm.offsets.at(b), cr.top() + cr.height()/4,
+                                         cm.offsets.at(e) - cm.offsets.at(b), cr.height()/2), color);
+            }
+        }
+    }
+    painter->restore();
+}
@@ -0,0 +1,193 @@
+#ifndef VERTICALTEXTLAYOUT_H
+#define VERTICALTEXTLAYOUT_H
+
+#include <QFont>
+#include <QFontMetricsF>
+#include <QColor>
+#include <QRectF>
+#include <QLineF>
+#include <QVector>
+#include <QHash>
+#include <QCache>
+#include <QRawFont>
+#include <QGlyphRun>
+#include "verticaltextdocument.h"
+#include "cverticalorientation.h"
+#include "cshapecache.h"
+
+class QPainter;
+
+//排版引擎：不依赖场景，根据文档计算列宽、字符位置、光标和选区几何，并负责绘制
+//度量结果按列缓存，文档修改后调用columnsChanged()使对应列失效
+class VerticalTextLayout
+{
+public:
+    enum Orientation {
+        Horizontal,
+        Vertical,
+    };
+    //取值与CGraphicsEdit::TextAlignment一致
+    enum Alignment {
+        AlignTop = 0,
+        AlignCenter,
+        AlignBottom,
+        AlignLeft,
+        AlignRight,
+        AlignHCenter,
+    };
+
+    VerticalTextLayout();
+
+    void setDocument(const VerticalTextDocument* doc);
+    const VerticalTextDocument* document() const { return m_doc; }
+    void setOrientation(Orientation o);
+    Orientation orientation() const { return m_orientation; }
+    void setAlignment(int alignment);
+    int alignment() const { return m_alignment; }
+    void setColumnSpacing(qreal spacing);
+    qreal columnSpacing() const { return m_columnSpacing; }
+    //空列按此格式计算列宽（通常是当前输入格式）
+    void setEmptyColumnFormat(int formatId);
+    //大量列失效时是否用多线程度量（已在工作线程中排版时关闭）
+    void setParallel(bool enabled) { m_parallel = enabled; }
+    //虚拟模式：只度量视口附近的列（最多VirtualColumns列），其余列按估计值排列
+    //各列宽度统一取已度量的最大值，列长按字数估算，度量到更大的值时逐步修正
+    void setVirtualized(bool enabled);
+    bool isVirtualized() const { return m_virtual; }
+
+    //first开始删除removed列、插入inserted列
+    void columnsChanged(int first, int removed, int inserted);
+    //文档开头移出count列（滚动显示），其余列的度量和起点保留，均摊O(1)
+    void columnsEvicted(int count);
+    void invalidate();
+    //每次排版失效时递增，用于判断缓存的绘制结果是否过期
+    int revision() const { return m_revision; }
+    //复制已完成的度量结果（不含字体缓存），用于在其他线程绘制doc的快照
+    void assignMetrics(const VerticalTextLayout& other, const VerticalTextDocument* doc);
+
+    QRectF boundingRect() const;
+    //列在排列方向上的起点（相对第一列）和宽度
+    qreal columnStart(int col) const;
+    qreal columnThickness(int col) const;
+    //列内文字长度（不含末尾字距）
+    qreal columnExtent(int col) const;
+    //列的矩形区域（item坐标）
+    QRectF columnRect(int col) const;
+    //pos之前的字符在列方向上的坐标（item坐标）
+    qreal charPosition(int col, int pos) const;
+    QLineF caretLine(int col, int pos) const;
+    QVector<QRectF> selectionRects(const STextRange& r) const;
+    //返回最近的列和字符间隙
+    void hitTest(const QPointF& p, int* col, int* pos) const;
+
+    //exposed为空时绘制全部列
+    void draw(QPainter* painter, const STextRange& selection, const QRectF& exposed = QRectF()) const;
+    //高亮一组按位置排序的范围（如查找结果），只绘制exposed内的列，在文字之前绘制
+    void drawHighlights(QPainter* painter, const QVector<STextRange>& ranges, const QColor& color, const QRectF& exposed = QRectF()) const;
+    //缩小显示时用色块代替文字，每个格式片段一个
+    void drawGreeked(QPainter* painter, const QRectF& exposed = QRectF()) const;
+    //列平均宽度，用于按缩放比例估算字符像素大小
+    qreal averageColumnThickness() const;
+
+    //统计信息：列度量缓存命中次数、绘制的字符数
+    typedef struct SStats{
+        quint64 columnHits = 0;
+        quint64 columnMisses = 0;
+        quint64 glyphs = 0;
+    } SStats;
+    const SStats& stats() const { return m_stats; }
+    void resetStats() { m_stats = SStats(); }
+
+    static const qreal Margin;
+    static const qreal MinimumSize;
+    static const int VirtualColumns;
+private:
+    typedef struct SFontInfo{
+        QFont         font;          //完整字体（横排直接使用）
+        QFont         plainFont;     //去掉上下划线、删除线（竖排自绘）
+        QFontMetricsF metrics{QFont()};
+        QColor        color;
+        qreal         letterSpacing = 0;
+        bool          underline = false;
+        bool          overline = false;
+        bool          strikeOut = false;
+        bool          largeGlyphs = false;   //字号很大时用缓存的轮廓绘制
+        QRawFont      rawFont;               //生成预排字形串
+        mutable QHash<ushort, qreal> widths;
+    } SFontInfo;
+
+    typedef struct SColumnMetrics{
+        qreal          thickness = 0;
+        qreal          extent = 0;
+        QVector<qreal> offsets;      //offsets[k]为第k个字符的起点，共length+1项
+        QVector<int>   runs;         //格式变化处的字符下标，首项为0
+        QVector<int>   sideways;     //竖排时旋转字符段的起止下标，成对排列
+        quint32        serial = 0;   //每次度量分配新序号
+        bool           valid = false;
+        quint64        shapeKey = 0;
+        CShapeCache::ColumnPointer shape;   //进程级缓存中的同一结果，空列为空
+    } SColumnMetrics;
+
+    //同一格式的一段字符，glyphs为空时逐字绘制（竖排旋转字符、大字号等）
+    typedef struct SPreparedRun{
+        int       begin = 0;
+        int       end = 0;
+        int       formatId = -1;
+        QGlyphRun glyphs;            //坐标相对列的起点
+    } SPreparedRun;
+
+    typedef QHash<int, SFontInfo> FontTable;
+
+    const SFontInfo& fontInfo(int formatId) const { return fontInfo(m_fonts, formatId); }
+    static const SFontInfo& fontInfo(FontTable& fonts, int formatId);
+    qreal charWidth(const SFontInfo& fi, QChar c) const;
+    //按UAX #50查表，竖排时需要旋转的字符
+    static bool isSideways(QChar c) { return CVerticalOrientation::isSideways(c.unicode()); }
+    void measureColumn(int col, SColumnMetrics& cm, FontTable& fonts) const;
+    //失效列较多时并行度量
+    void measureInvalidColumns() const;
+    //m_columns中index开始的count列将被移除或重算
+    void dropExtents(int index, int count);
+    const SColumnMetrics& column(int col) const;
+    //虚拟模式下根据新度量的列修正估计值
+    void refineEstimates(const SColumnMetrics& cm) const;
+    void ensureEstimates() const;
+    void ensurePrefix() const;
+    qreal flowStart(int col) const { return flowStartFor(columnExtent(col)); }
+    qreal flowStartFor(qreal extent) const;
+    int firstColumnAt(qreal distance) const;
+    void columnRangeFor(const QRectF& exposed, int* first, int* last) const;
+    //未修改的列复用上次生成的字形串，绘制时不再排版
+    const QVector<SPreparedRun>& preparedRuns(int col, const SColumnMetrics& cm) const;
+    //生成字形序号和列宽为0时的位置，结果存入CShapeCache
+    QVector<CShapeCache::SShapedRun> shapeRuns(int col, const SColumnMetrics& cm) const;
+    void drawVerticalChar(QPainter* painter, const SFontInfo& fi, int formatId, QChar c,
+                          const QRectF& cr, qreal y, const QColor& color) const;
+    void drawVerticalDecorations(QPainter* painter, const SFontInfo& fi, const QRectF& cr, qreal y, qreal next) const;
+    void drawVertical(QPainter* painter, const STextRange& sel, int first, int last, const QRectF& clip) const;
+    void drawHorizontal(QPainter* painter, const STextRange& sel, int first, int last, const QRectF& clip) const;
+private:
+    const VerticalTextDocument*      m_doc = nullptr;
+    Orientation                      m_orientation = Vertical;
+    int                              m_alignment = AlignTop;
+    qreal                            m_columnSpacing = 0;
+    int                              m_emptyFormat = -1;
+    bool                             m_parallel = true;
+    mutable FontTable                m_fonts;
+    mutable QVector<SColumnMetrics>  m_columns;     //从m_head开始是第0列
+    mutable QVector<qreal>           m_starts;      //各列起点前缀和，与m_columns对应
+    mutable int                      m_head = 0;    //已移出但尚未整理掉的列
+    mutable int                      m_prefixValid = 0;   //失效的列都不在它之前
+    mutable qreal                    m_maxExtent = 0;
+    mutable bool                     m_extentValid = false;
+    mutable QHash<quint32, QVector<SPreparedRun>> m_prepared;
+    bool                             m_virtual = false;
+    mutable QCache<qint64, SColumnMetrics> m_window;   //虚拟模式下已度量的列，按绝对列号
+    qint64                           m_evicted = 0; //累计移出的列数
+    mutable qreal                    m_pitch = 0;   //虚拟模式的统一列宽
+    mutable qreal                    m_advance = 0; //虚拟模式估算列长用的平均字符步进
+    mutable SStats                   m_stats;
+    mutable int                      m_revision = 0;
+};
+
+#endif // VERTICALTEXTLAYOUT_H
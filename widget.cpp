@@ -2,6 +2,8 @@
 #include <QGraphicsView>
 #include <QGraphicsScene>
 #include "cgraphicsedit.h"
+#include "cpropertycoalescer.h"
+#include "cscenesearch.h"
 #include <QPushButton>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -10,6 +12,10 @@
 #include <QLabel>
 #include <QColorDialog>
 #include <QFile>
+#include <QTimer>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QLineEdit>
 
 Widget::Widget(QWidget *parent)
     : QWidget(parent)
@@ -50,6 +56,29 @@ Widget::Widget(QWidget *parent)
 
     view->setScene(scene);
 
+    tiledCheckBox = new QCheckBox(tr("Tiled render"));
+    virtualCheckBox = new QCheckBox(tr("Virtualized"));
+    findEdit = new QLineEdit;
+    findEdit->setPlaceholderText(tr("Find"));
+    replaceEdit = new QLineEdit;
+    replaceEdit->setPlaceholderText(tr("Replace with"));
+    matchCaseCheckBox = new QCheckBox(tr("Match case"));
+    matchLabel = new QLabel;
+    sceneSearch = new CSceneSearch(this);
+    perfCheckBox = new QCheckBox(tr("Perf HUD"));
+    perfLabel = new QLabel(view);
+    perfLabel->setStyleSheet("background-color: rgba(0, 0, 0, 160); color: #00FF00; padding: 4px;");
+    perfLabel->setFont(QFont("Consolas", 9));
+    perfLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+    perfLabel->move(8, 8);
+    perfLabel->hide();
+    perfTimer = new QTimer(this);
+    perfTimer->setInterval(250);
+
+    fontSizeCoalescer = new CPropertyCoalescer(this);
+    rowSpacingCoalescer = new CPropertyCoalescer(this);
+    letterSpacingCoalescer = new CPropertyCoalescer(this);
+
     QHBoxLayout* hLayout = new QHBoxLayout;
     hLayout->addWidget(new QLabel(tr("TextSize: ")));
     hLayout->addWidget(slider);
@@ -58,8 +87,29 @@ Widget::Widget(QWidget *parent)
     QHBoxLayout* hLayout2 = new QHBoxLayout;
     QPushButton* saveBtn = new QPushButton(tr("Save"));
     QPushButton* loadBtn = new QPushButton(tr("Load"));
+    QPushButton* viewBtn = new QPushButton(tr("View file"));
     hLayout2->addWidget(saveBtn);
     hLayout2->addWidget(loadBtn);
+    hLayout2->addWidget(viewBtn);
+    QPushButton* importBtn = new QPushButton(tr("Import text"));
+    hLayout2->addWidget(importBtn);
+
+    QHBoxLayout* findLayout = new QHBoxLayout;
+    QPushButton* findBtn = new QPushButton(tr("Find next"));
+    findLayout->addWidget(findEdit);
+    findLayout->addWidget(findBtn);
+    QPushButton* findSceneBtn = new QPushButton(tr("Find in scene"));
+    findLayout->addWidget(findSceneBtn);
+    QHBoxLayout* replaceLayout = new QHBoxLayout;
+    QPushButton* replaceBtn = new QPushButton(tr("Replace"));
+    QPushButton* replaceAllBtn = new QPushButton(tr("Replace all"));
+    replaceLayout->addWidget(replaceEdit);
+    replaceLayout->addWidget(replaceBtn);
+    replaceLayout->addWidget(replaceAllBtn);
+    QHBoxLayout* matchLayout = new QHBoxLayout;
+    matchLayout->addWidget(matchCaseCheckBox);
+    matchLayout->addWidget(matchLabel);
+    matchLayout->addStretch();
 
     QVBoxLayout* vLayout = new QVBoxLayout;
     vLayout->addWidget(fontComboBox);
@@ -75,6 +125,12 @@ Widget::Widget(QWidget *parent)
     vLayout->addWidget(letterspacingComboBox);
     vLayout->addWidget(directionComboBox);
     vLayout->addLayout(hLayout2);
+    vLayout->addWidget(tiledCheckBox);
+    vLayout->addWidget(virtualCheckBox);
+    vLayout->addWidget(perfCheckBox);
+    vLayout->addLayout(findLayout);
+    vLayout->addLayout(replaceLayout);
+    vLayout->addLayout(matchLayout);
     vLayout->addStretch();
 
     QHBoxLayout* mainLayout = new QHBoxLayout();
@@ -86,16 +142,54 @@ Widget::Widget(QWidget *parent)
     connect(colorBtn, &QPushButton::clicked, this, &Widget::onSelectColor);
     connect(saveBtn, &QPushButton::clicked, this, &Widget::onSave);
     connect(loadBtn, &QPushButton::clicked, this, &Widget::onLoad);
+    connect(viewBtn, &QPushButton::clicked, this, &Widget::onViewFile);
+    connect(importBtn, &QPushButton::clicked, this, &Widget::onImportText);
+    connect(textEdit, &CGraphicsEdit::importFinished, this, [this](bool ok, const QString& error) {
+        if (!ok && !error.isEmpty())
+            QMessageBox::warning(this, tr("Import text"), error);
+    });
     connect(boldCheckBox, &QCheckBox::clicked, this, &Widget::onCheckBoxClicked);
     connect(italicCheckBox, &QCheckBox::clicked, this, &Widget::onCheckBoxClicked);
     connect(delLineCheckBox, &QCheckBox::clicked, this, &Widget::onCheckBoxClicked);
     connect(underlineCheckBox, &QCheckBox::clicked, this, &Widget::onCheckBoxClicked);
     connect(strikeOutCheckBox, &QCheckBox::clicked, this, &Widget::onCheckBoxClicked);
     connect(slider, &QSlider::valueChanged, this, &Widget::onFontSizeChanged);
+    connect(slider, &QSlider::sliderPressed, fontSizeCoalescer, &CPropertyCoalescer::hold);
+    connect(slider, &QSlider::sliderReleased, fontSizeCoalescer, &CPropertyCoalescer::release);
+    connect(fontSizeCoalescer, &CPropertyCoalescer::started, textEdit, &CGraphicsEdit::beginFormatChange);
+    connect(fontSizeCoalescer, &CPropertyCoalescer::preview, this, &Widget::onFontSizePreview);
+    connect(fontSizeCoalescer, &CPropertyCoalescer::committed, textEdit, &CGraphicsEdit::endFormatChange);
+    connect(rowSpacingCoalescer, &CPropertyCoalescer::started, textEdit, &CGraphicsEdit::beginFormatChange);
+    connect(rowSpacingCoalescer, &CPropertyCoalescer::preview, this, &Widget::onRowSpacePreview);
+    connect(rowSpacingCoalescer, &CPropertyCoalescer::committed, textEdit, &CGraphicsEdit::endFormatChange);
+    connect(letterSpacingCoalescer, &CPropertyCoalescer::started, textEdit, &CGraphicsEdit::beginFormatChange);
+    connect(letterSpacingCoalescer, &CPropertyCoalescer::preview, this, &Widget::onLetterSpacePreview);
+    connect(letterSpacingCoalescer, &CPropertyCoalescer::committed, textEdit, &CGraphicsEdit::endFormatChange);
     connect(rowspacingComboBox, &QComboBox::currentTextChanged, this, &Widget::onRowSpaceChanged);
     connect(aligentComboBox, &QComboBox::currentTextChanged, this, &Widget::onaligentchanged);
     connect(letterspacingComboBox, &QComboBox::currentTextChanged, this, &Widget::onLetterSpaceChanged);
     connect(directionComboBox, &QComboBox::currentTextChanged, this, &Widget::onDirectionChanged);
+    connect(tiledCheckBox, &QCheckBox::toggled, textEdit, &CGraphicsEdit::setTiledRendering);
+    connect(virtualCheckBox, &QCheckBox::toggled, textEdit, &CGraphicsEdit::setVirtualized);
+    connect(textEdit, &CGraphicsEdit::virtualizedChanged, virtualCheckBox, &QCheckBox::setChecked);
+    connect(findEdit, &QLineEdit::textChanged, this, &Widget::onSearchChanged);
+    connect(matchCaseCheckBox, &QCheckBox::toggled, this, &Widget::onSearchChanged);
+    connect(findEdit, &QLineEdit::returnPressed, this, &Widget::onFindNext);
+    connect(findBtn, &QPushButton::clicked, this, &Widget::onFindNext);
+    connect(findSceneBtn, &QPushButton::clicked, this, &Widget::onFindInScene);
+    connect(sceneSearch, &CSceneSearch::hitsFound, this, [this](int first, int count) {
+        Q_UNUSED(count);
+        if (first == 0)
+            sceneSearch->select(0);
+        matchLabel->setText(tr("Searching... %1 matches").arg(sceneSearch->hits().size()));
+    });
+    connect(sceneSearch, &CSceneSearch::finished, this, [this](int total) {
+        matchLabel->setText(tr("%1 matches in scene").arg(total));
+    });
+    connect(replaceBtn, &QPushButton::clicked, this, &Widget::onReplace);
+    connect(replaceAllBtn, &QPushButton::clicked, this, &Widget::onReplaceAll);
+    connect(perfCheckBox, &QCheckBox::toggled, this, &Widget::onPerfHudToggled);
+    connect(perfTimer, &QTimer::timeout, this, &Widget::onUpdatePerfHud);
 }
 
 void Widget::onSelectColor()
@@ -129,6 +223,56 @@ void Widget::onLoad()
     textEdit->setText(htmlStr);
 }
 
+void Widget::onViewFile()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("View file"), QString(),
+                                                          tr("Text files (*.txt *.log);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+    QString error;
+    if (!textEdit->openMappedFile(fileName, &error)) {
+        QMessageBox::warning(this, tr("View file"), error);
+    }
+}
+
+void Widget::onImportText()
+{
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Import text"), QString(),
+                                                          tr("Text files (*.txt *.log);;All files (*)"));
+    if (fileName.isEmpty())
+        return;
+    //文件在导入线程中打开和关闭
+    textEdit->importPlainText(new QFile(fileName));
+}
+
+void Widget::onSearchChanged()
+{
+    textEdit->setSearchPattern(findEdit->text(), matchCaseCheckBox->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive);
+    matchLabel->setText(findEdit->text().isEmpty() ? QString() : tr("%1 matches").arg(textEdit->matchCount()));
+}
+
+void Widget::onFindNext()
+{
+    textEdit->findNext();
+}
+
+void Widget::onFindInScene()
+{
+    sceneSearch->start(view->scene(), findEdit->text(), matchCaseCheckBox->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive);
+}
+
+void Widget::onReplace()
+{
+    textEdit->replaceNext(replaceEdit->text());
+    onSearchChanged();
+}
+
+void Widget::onReplaceAll()
+{
+    textEdit->replaceAll(replaceEdit->text());
+    onSearchChanged();
+}
+
 void Widget::onCheckBoxClicked(bool checked)
 {
     QCheckBox* box = (QCheckBox*)sender();
@@ -147,13 +291,12 @@ void Widget::onCheckBoxClicked(bool checked)
 
 void Widget::onFontSizeChanged(int value)
 {
-    textEdit->setFontSize(value);
+    fontSizeCoalescer->setValue(value);
 }
 
 void Widget::onRowSpaceChanged(const QString& text)
 {
-    int spacing = text.toInt();
-    textEdit->setColumnSpacing(spacing);
+    rowSpacingCoalescer->setValue(text.toInt());
 }
 
 void Widget::onaligentchanged(const QString& text)
@@ -163,8 +306,7 @@ void Widget::onaligentchanged(const QString& text)
 
 void Widget::onLetterSpaceChanged(const QString& text)
 {
-    int spacing = text.toInt();
-    textEdit->setLetterSpacing(spacing);
+    letterSpacingCoalescer->setValue(text.toInt());
 }
 
 void Widget::onDirectionChanged(const QString& text)
@@ -176,3 +318,50 @@ void Widget::onDirectionChanged(const QString& text)
     }
 }
 
+void Widget::onFontSizePreview(const QVariant& value)
+{
+    textEdit->setFontSize(value.toInt());
+}
+
+void Widget::onRowSpacePreview(const QVariant& value)
+{
+    textEdit->setColumnSpacing(value.toInt());
+}
+
+void Widget::onLetterSpacePreview(const QVariant& value)
+{
+    textEdit->setLetterSpacing(value.toInt());
+}
+
+void Widget::onPerfHudToggled(bool checked)
+{
+    if (checked) {
+        textEdit->resetPerfStats();
+        onUpdatePerfHud();
+        perfLabel->show();
+        perfLabel->raise();
+        perfTimer->start();
+    } else {
+        perfTimer->stop();
+        perfLabel->hide();
+    }
+}
+
+void Widget::onUpdatePerfHud()
+{
+    const SPerfStats ps = textEdit->perfStats();
+    perfLabel->setText(QString("input->paint  p50 %1 ms  p95 %2 ms  p99 %3 ms  (%4)\n"
+                               "paint %5 ms  glyphs %6  layout cache %7%\n"
+                               "shape cache %8%  %9 columns  %10 KB")
+                       .arg(ps.latencyP50 / 1000.0, 0, 'f', 2)
+                       .arg(ps.latencyP95 / 1000.0, 0, 'f', 2)
+                       .arg(ps.latencyP99 / 1000.0, 0, 'f', 2)
+                       .arg(ps.samples)
+                       .arg(ps.paintTime / 1000.0, 0, 'f', 2)
+                       .arg(ps.glyphs)
+                       .arg(ps.cacheHitRate * 100, 0, 'f', 1)
+                       .arg(ps.shapeHitRate * 100, 0, 'f', 1)
+                       .arg(ps.shapeEntries)
+                       .arg(ps.shapeKilobytes));
+    perfLabel->adjustSize();
+}
@@ -2,13 +2,19 @@
 #define WIDGET_H
 
 #include <QWidget>
+#include <QVariant>
 class QFontComboBox;
 class QPushButton;
 class QSlider;
 class QGraphicsView;
 class QCheckBox;
 class QComboBox;
+class QLabel;
+class QLineEdit;
+class QTimer;
 class CGraphicsEdit;
+class CPropertyCoalescer;
+class CSceneSearch;
 
 class Widget : public QWidget
 {
@@ -20,12 +26,29 @@ public slots:
     void onSelectColor();
     void onSave();
     void onLoad();
+    //只读浏览大文本文件
+    void onViewFile();
+    //流式导入纯文本
+    void onImportText();
+    //查找替换
+    void onSearchChanged();
+    void onFindNext();
+    void onReplace();
+    void onReplaceAll();
+    //在场景中所有文本框里查找
+    void onFindInScene();
     void onCheckBoxClicked(bool checked = false);
     void onFontSizeChanged(int value);
     void onRowSpaceChanged(const QString& text);
     void onaligentchanged(const QString& text);
     void onLetterSpaceChanged(const QString& text);
     void onDirectionChanged(const QString& text);
+    void onFontSizePreview(const QVariant& value);
+    void onRowSpacePreview(const QVariant& value);
+    void onLetterSpacePreview(const QVariant& value);
+    //性能面板
+    void onPerfHudToggled(bool checked);
+    void onUpdatePerfHud();
 private:
     QFontComboBox* fontComboBox;
     QPushButton*   colorBtn;
@@ -41,6 +64,21 @@ private:
     QComboBox*     letterspacingComboBox;
     QComboBox*     directionComboBox;
     CGraphicsEdit* textEdit;
+    //合并连续的属性修改
+    CPropertyCoalescer* fontSizeCoalescer;
+    CPropertyCoalescer* rowSpacingCoalescer;
+    CPropertyCoalescer* letterSpacingCoalescer;
+    QCheckBox*     tiledCheckBox;
+    QCheckBox*     virtualCheckBox;
+    QLineEdit*     findEdit;
+    QLineEdit*     replaceEdit;
+    QCheckBox*     matchCaseCheckBox;
+    QLabel*        matchLabel;
+    CSceneSearch*  sceneSearch;
+    //性能面板（覆盖在视图左上角）
+    QCheckBox*     perfCheckBox;
+    QLabel*        perfLabel;
+    QTimer*        perfTimer;
 };
 
 #endif // WIDGET_H